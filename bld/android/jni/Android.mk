@@ -8,6 +8,18 @@ LOCAL_ARM_MODE := arm
 LOCAL_SRC_FILES:= \
 	ffdecoder.cpp  \
 	ffencoder.cpp  \
+	ffmixer.cpp    \
+	ffformat.cpp   \
+	ffthread.cpp   \
+	ffchunk.cpp    \
+	ffbatch.cpp    \
+	ffalloc.cpp    \
+	ffrtp.cpp      \
+	ffmetric.cpp   \
+	ffscene.cpp    \
+	ffinspect.cpp  \
+	ffframe.cpp    \
+	ffplace.cpp    \
 	ffcodec.cpp
 
 LOCAL_SHARED_LIBRARIES := 
@@ -24,3 +36,37 @@ LOCAL_C_INCLUDES := 	\
 LOCAL_CFLAGS := -DANDROID -Wdeprecated-declarations
 
 include $(BUILD_SHARED_LIBRARY)
+
+
+# tests(executables), e.g. ndk-build APP_MODULES="ffcodec ffrtp_test ffmetric_test ffmixer_test ffinspect_test"
+include $(CLEAR_VARS)
+LOCAL_MODULE := ffrtp_test
+LOCAL_SRC_FILES := ../test/ffrtp_test.cpp
+LOCAL_C_INCLUDES := $(LOCAL_PATH) $(EXT_PATH)
+LOCAL_CFLAGS := -DANDROID
+LOCAL_SHARED_LIBRARIES := ffcodec
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := ffmetric_test
+LOCAL_SRC_FILES := ../test/ffmetric_test.cpp
+LOCAL_C_INCLUDES := $(LOCAL_PATH) $(EXT_PATH)
+LOCAL_CFLAGS := -DANDROID
+LOCAL_SHARED_LIBRARIES := ffcodec
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := ffmixer_test
+LOCAL_SRC_FILES := ../test/ffmixer_test.cpp
+LOCAL_C_INCLUDES := $(LOCAL_PATH) $(EXT_PATH)
+LOCAL_CFLAGS := -DANDROID
+LOCAL_SHARED_LIBRARIES := ffcodec
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := ffinspect_test
+LOCAL_SRC_FILES := ../test/ffinspect_test.cpp
+LOCAL_C_INCLUDES := $(LOCAL_PATH) $(EXT_PATH)
+LOCAL_CFLAGS := -DANDROID
+LOCAL_SHARED_LIBRARIES := ffcodec
+include $(BUILD_EXECUTABLE)
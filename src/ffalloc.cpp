@@ -0,0 +1,420 @@
+#include "ffalloc.h"
+#include "fflog.h"
+#include "ffcodec.h"
+#include <sys/mman.h>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+#define SLAB_SIZE   (2*1024*1024)   // hugepage size
+#define SLAB_BLOCKS 4               // min large blocks packed in one slab
+#define BLOCK_ALIGN 4096
+#define FRAME_ALIGN 64              // linesize and plane alignment
+#define MPOL_PREFERRED_MODE 1       // as MPOL_PREFERRED of linux/mempolicy.h
+
+static void *map_slab(size_t size) {
+    void *ptr = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (ptr == MAP_FAILED) {
+        ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        returnv_if_fail(ptr != MAP_FAILED, NULL);
+#ifdef MADV_HUGEPAGE
+        madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+    }
+    return ptr;
+}
+
+/* aligned linesizes and plane offsets, return buffer size(>0) if success, else < 0 */
+static int frame_layout(AVCodecContext *avctx, AVPixelFormat pix_fmt, int width, int height,
+        int linesizes[4], intptr_t offsets[4])
+{
+    if (avctx) {
+        int linesize_align[AV_NUM_DATA_POINTERS];
+        avcodec_align_dimensions2(avctx, &width, &height, linesize_align);
+    }
+
+    int iret = av_image_fill_linesizes(linesizes, pix_fmt, width);
+    returnv_if_fail(iret >= 0, -1);
+    for (int i = 0; i < 4; i++) {
+        linesizes[i] = FFALIGN(linesizes[i], FRAME_ALIGN);
+    }
+
+    uint8_t *data[4] = { 0 };
+    int size = av_image_fill_pointers(data, pix_fmt, height, NULL, linesizes);
+    returnv_if_fail(size > 0, -1);
+    for (int i = 0; i < 4; i++) {
+        offsets[i] = (intptr_t)data[i];
+    }
+
+    // extra space for codecs reading over the edge
+    return size + FRAME_ALIGN + AV_INPUT_BUFFER_PADDING_SIZE;
+}
+
+
+static pthread_once_t s_slab_once = PTHREAD_ONCE_INIT;
+static FFSlabAllocator *s_slab_allocator = NULL;
+static void create_slab_allocator() {
+    s_slab_allocator = new FFSlabAllocator();
+}
+
+FFSlabAllocator *FFSlabAllocator::instance() {
+    pthread_once(&s_slab_once, create_slab_allocator);
+    return s_slab_allocator;
+}
+
+FFSlabAllocator::FFSlabAllocator() {
+    m_reserved = 0;
+}
+
+FFSlabAllocator::~FFSlabAllocator() {
+    std::map<uintptr_t, std::pair<size_t, Slab *> >::iterator iter;
+    for (iter = m_slabs.begin(); iter != m_slabs.end(); iter++) {
+        Slab *slab = iter->second.second;
+        munmap(slab->data, slab->size);
+        delete slab;
+    }
+    m_slabs.clear();
+    m_classes.clear();
+}
+
+void *FFSlabAllocator::mapSlab(size_t size) {
+    return map_slab(size);
+}
+
+size_t FFSlabAllocator::getBlockSize(size_t size) {
+    return FFALIGN(size, BLOCK_ALIGN);
+}
+
+// small blocks share one hugepage, and large ones are packed into whole hugepages
+// (e.g. 4 blocks of 1080p I420 in 12MB instead of 4MB each).
+size_t FFSlabAllocator::getSlabSize(size_t block_size) {
+    if (block_size * SLAB_BLOCKS <= SLAB_SIZE)
+        return SLAB_SIZE;
+    return FFALIGN(block_size * SLAB_BLOCKS, SLAB_SIZE);
+}
+
+void *FFSlabAllocator::alloc(size_t size) {
+    returnv_if_fail(size > 0, NULL);
+    size_t block_size = getBlockSize(size);
+
+    FFAutoLock lock(m_mutex);
+    SizeClass &sclass = m_classes[block_size];
+
+    // take from the fullest slab, so that others may become free and be unmapped
+    Slab *slab = NULL;
+    for (size_t i = 0; i < sclass.slabs.size(); i++) {
+        Slab *item = sclass.slabs[i];
+        if (!item->blocks.empty() && (!slab || item->used > slab->used))
+            slab = item;
+    }
+
+    if (!slab) {
+        size_t slab_size = getSlabSize(block_size);
+        uint8_t *data = (uint8_t *)mapSlab(slab_size);
+        returnv_if_fail(data, NULL);
+        slab = new Slab;
+        slab->data = data;
+        slab->size = slab_size;
+        slab->used = 0;
+        for (size_t offset = 0; offset + block_size <= slab_size; offset += block_size) {
+            slab->blocks.push_back(data + offset);
+        }
+        sclass.slabs.push_back(slab);
+        m_slabs[(uintptr_t)data] = std::make_pair(block_size, slab);
+        m_reserved += slab_size;
+    }
+
+    void *ptr = slab->blocks.back();
+    slab->blocks.pop_back();
+    slab->used++;
+    return ptr;
+}
+
+void FFSlabAllocator::free(void *ptr, size_t size) {
+    return_if_fail(ptr);
+    FFAutoLock lock(m_mutex);
+
+    // the slab containing ptr
+    std::map<uintptr_t, std::pair<size_t, Slab *> >::iterator iter = m_slabs.upper_bound((uintptr_t)ptr);
+    return_if_fail(iter != m_slabs.begin());
+    iter--;
+    size_t block_size = iter->second.first;
+    Slab *slab = iter->second.second;
+    return_if_fail((uint8_t *)ptr < slab->data + slab->size);
+    if (block_size != getBlockSize(size)) {
+        LOGW("free size="<<size<<" mismatches block size="<<block_size);
+    }
+
+    slab->blocks.push_back(ptr);
+    if (--slab->used > 0)
+        return;
+
+    // unmap when all blocks are free
+    std::vector<Slab *> &slabs = m_classes[block_size].slabs;
+    for (size_t i = 0; i < slabs.size(); i++) {
+        if (slabs[i] == slab) {
+            slabs.erase(slabs.begin() + i);
+            break;
+        }
+    }
+    if (slabs.empty())
+        m_classes.erase(block_size);
+    m_slabs.erase(iter);
+    m_reserved -= slab->size;
+    munmap(slab->data, slab->size);
+    delete slab;
+}
+
+int64_t FFSlabAllocator::getReservedBytes() {
+    FFAutoLock lock(m_mutex);
+    return m_reserved;
+}
+
+
+static FFMutex s_node_mutex;
+static std::map<int, FFNodeAllocator *> s_node_allocators;
+
+FFNodeAllocator *FFNodeAllocator::instance(int node) {
+    returnv_if_fail(node >= 0, NULL);
+    FFAutoLock lock(s_node_mutex);
+    FFNodeAllocator *&allocator = s_node_allocators[node];
+    if (!allocator)
+        allocator = new FFNodeAllocator(node);
+    return allocator;
+}
+
+FFNodeAllocator::FFNodeAllocator(int node) {
+    m_node = node;
+}
+
+int FFNodeAllocator::getNode() const {
+    return m_node;
+}
+
+// bind before first touch, so pages are faulted on the node
+void *FFNodeAllocator::mapSlab(size_t size) {
+    void *ptr = FFSlabAllocator::mapSlab(size);
+    returnv_if_fail(ptr, NULL);
+#if defined(__linux__) && defined(__NR_mbind)
+    const int bits = 8 * sizeof(unsigned long);
+    std::vector<unsigned long> mask(m_node / bits + 1, 0);
+    mask[m_node / bits] = 1UL << (m_node % bits);
+    if (syscall(__NR_mbind, ptr, size, MPOL_PREFERRED_MODE, &mask[0], mask.size() * bits + 1, 0) != 0) {
+        LOGW("fail to bind slab to node="<<m_node);
+    }
+#endif
+    return ptr;
+}
+
+
+// shared by arena and its buffers
+struct FFArena::State {
+    struct Block {
+        State *state;
+        uint8_t *data;
+        int size;
+    };
+
+    FFMutex mutex;
+    FFAllocator *allocator;
+    AVCodecContext *avctx;  // attached decoder
+    int refs;               // arena and buffers in use
+    bool closed;            // arena is destroyed
+    int64_t bytes;          // in use and pooled
+    std::map<int, std::vector<Block *> > pool;
+};
+
+FFArena::FFArena() {
+    m_state = new State;
+    m_state->allocator = FFSlabAllocator::instance();
+    m_state->avctx = NULL;
+    m_state->refs = 1;
+    m_state->closed = false;
+    m_state->bytes = 0;
+}
+
+FFArena::~FFArena() {
+    m_state->mutex.lock();
+    m_state->closed = true;
+    m_state->avctx = NULL;
+    std::map<int, std::vector<State::Block *> >::iterator iter;
+    for (iter = m_state->pool.begin(); iter != m_state->pool.end(); iter++) {
+        for (size_t i = 0; i < iter->second.size(); i++) {
+            State::Block *block = iter->second[i];
+            m_state->allocator->free(block->data, block->size);
+            m_state->bytes -= block->size;
+            delete block;
+        }
+    }
+    m_state->pool.clear();
+    m_state->mutex.unlock();
+
+    releaseState(m_state);
+    m_state = NULL;
+}
+
+void FFArena::releaseState(State *state) {
+    state->mutex.lock();
+    bool last = (--state->refs == 0);
+    state->mutex.unlock();
+    if (last)
+        delete state;
+}
+
+void FFArena::setAllocator(FFAllocator *allocator) {
+    FFAutoLock lock(m_state->mutex);
+    if (m_state->bytes > 0) {
+        LOGW("allocator cannot be changed after allocation");
+        return;
+    }
+    m_state->allocator = allocator ? allocator : FFSlabAllocator::instance();
+}
+
+// return 0 if success, else < 0
+long FFArena::reserve(const FFVideoFormat &fmt, int count) {
+    AVPixelFormat pix_fmt = GetAVPixelFormat(fmt.pix_fmt);
+    returnv_if_fail(pix_fmt != AV_PIX_FMT_NONE, -1);
+
+    int linesizes[4];
+    intptr_t offsets[4];
+    m_state->mutex.lock();
+    AVCodecContext *avctx = m_state->avctx;
+    m_state->mutex.unlock();
+    int size = frame_layout(avctx, pix_fmt, fmt.width, fmt.height, linesizes, offsets);
+    returnv_if_fail(size > 0, -1);
+
+    // get all and release all into pool
+    std::vector<AVBufferRef *> bufs;
+    for (int i = 0; i < count; i++) {
+        AVBufferRef *buf = getBuffer(size);
+        if (!buf)
+            break;
+        bufs.push_back(buf);
+    }
+    bool success = ((int)bufs.size() == count);
+    for (size_t i = 0; i < bufs.size(); i++) {
+        av_buffer_unref(&bufs[i]);
+    }
+    return success ? 0 : -1;
+}
+
+AVBufferRef *FFArena::getBuffer(int size) {
+    returnv_if_fail(size > 0, NULL);
+
+    State::Block *block = NULL;
+    m_state->mutex.lock();
+    std::vector<State::Block *> &blocks = m_state->pool[size];
+    if (!blocks.empty()) {
+        block = blocks.back();
+        blocks.pop_back();
+    }
+    FFAllocator *allocator = m_state->allocator;
+    m_state->mutex.unlock();
+
+    if (!block) {
+        uint8_t *data = (uint8_t *)allocator->alloc(size);
+        returnv_if_fail(data, NULL);
+        block = new State::Block;
+        block->state = m_state;
+        block->data = data;
+        block->size = size;
+
+        FFAutoLock lock(m_state->mutex);
+        m_state->bytes += size;
+    }
+
+    m_state->mutex.lock();
+    m_state->refs++;
+    m_state->mutex.unlock();
+
+    AVBufferRef *buf = av_buffer_create(block->data, size, releaseBuffer, block, 0);
+    if (!buf) {
+        releaseBuffer(block, block->data); // back to pool
+        return NULL;
+    }
+    return buf;
+}
+
+void FFArena::releaseBuffer(void *opaque, uint8_t *) {
+    State::Block *block = (State::Block *)opaque;
+    State *state = block->state;
+
+    state->mutex.lock();
+    if (state->closed) {
+        state->allocator->free(block->data, block->size);
+        state->bytes -= block->size;
+        delete block;
+    }else {
+        state->pool[block->size].push_back(block);
+    }
+    state->mutex.unlock();
+    releaseState(state);
+}
+
+// return 0 if success, else < 0
+long FFArena::allocFrame(AVFrame *frame) {
+    returnv_if_fail(frame && frame->width > 0 && frame->height > 0, -1);
+
+    int linesizes[4];
+    intptr_t offsets[4];
+    int size = frame_layout(NULL, (AVPixelFormat)frame->format, frame->width, frame->height, linesizes, offsets);
+    returnv_if_fail(size > 0, -1);
+
+    AVBufferRef *buf = getBuffer(size);
+    returnv_if_fail(buf, -1);
+
+    frame->buf[0] = buf;
+    for (int i = 0; i < 4; i++) {
+        frame->linesize[i] = linesizes[i];
+        frame->data[i] = linesizes[i] > 0 ? buf->data + offsets[i] : NULL;
+    }
+    frame->extended_data = frame->data;
+    return 0;
+}
+
+// return 0 if success, else < 0
+long FFArena::attach(AVCodecContext *avctx) {
+    returnv_if_fail(avctx, -1);
+    avctx->opaque = this;
+    avctx->get_buffer2 = getBuffer2;
+    avctx->thread_safe_callbacks = 1; // arena is locked, for frame threads
+
+    FFAutoLock lock(m_state->mutex);
+    m_state->avctx = avctx;
+    return 0;
+}
+
+int FFArena::getBuffer2(AVCodecContext *avctx, AVFrame *frame, int flags) {
+    FFArena *arena = (FFArena *)avctx->opaque;
+    if (!arena || avctx->codec_type != AVMEDIA_TYPE_VIDEO ||
+        !(avctx->codec->capabilities & AV_CODEC_CAP_DR1)) {
+        return avcodec_default_get_buffer2(avctx, frame, flags);
+    }
+
+    int linesizes[4];
+    intptr_t offsets[4];
+    int size = frame_layout(avctx, (AVPixelFormat)frame->format, frame->width, frame->height, linesizes, offsets);
+    if (size <= 0) {
+        return avcodec_default_get_buffer2(avctx, frame, flags);
+    }
+
+    AVBufferRef *buf = arena->getBuffer(size);
+    returnv_if_fail(buf, AVERROR(ENOMEM));
+
+    frame->buf[0] = buf;
+    for (int i = 0; i < 4; i++) {
+        frame->linesize[i] = linesizes[i];
+        frame->data[i] = linesizes[i] > 0 ? buf->data + offsets[i] : NULL;
+    }
+    frame->extended_data = frame->data;
+    return 0;
+}
+
+int64_t FFArena::getUsedBytes() {
+    FFAutoLock lock(m_state->mutex);
+    return m_state->bytes;
+}
@@ -0,0 +1,96 @@
+#ifndef __FFALLOC_H_
+#define __FFALLOC_H_
+
+#include "ffparam.h"
+#include "ffthread.h"
+#include <map>
+
+// pluggable allocator for frame buffers, must outlive all its buffers
+class FF_EXPORT FFAllocator {
+public:
+    virtual ~FFAllocator() {}
+    virtual void *alloc(size_t size) = 0;
+    virtual void free(void *ptr, size_t size) = 0;
+};
+
+// default allocator: blocks of one size class are carved from hugepage-backed slabs,
+// freed blocks are reused by any session, and a slab is unmapped once all its blocks are free.
+class FF_EXPORT FFSlabAllocator : public FFAllocator {
+public:
+    static FFSlabAllocator *instance();
+
+    FFSlabAllocator();
+    virtual ~FFSlabAllocator();
+
+    virtual void *alloc(size_t size);
+    virtual void free(void *ptr, size_t size);
+
+    int64_t getReservedBytes();     // bytes mapped from system
+
+protected:
+    virtual void *mapSlab(size_t size);
+
+    struct Slab {
+        uint8_t *data;
+        size_t size;
+        std::vector<void *> blocks; // free blocks
+        int used;                   // blocks in use
+    };
+    struct SizeClass {
+        std::vector<Slab *> slabs;
+    };
+    static size_t getBlockSize(size_t size);
+    static size_t getSlabSize(size_t block_size);
+
+private:
+    FFMutex m_mutex;
+    std::map<size_t, SizeClass> m_classes;
+    std::map<uintptr_t, std::pair<size_t, Slab *> > m_slabs;  // by address, with its block size
+    int64_t m_reserved;
+};
+
+// slab allocator whose slabs are bound to one numa node(preferred, Linux only)
+class FF_EXPORT FFNodeAllocator : public FFSlabAllocator {
+public:
+    static FFNodeAllocator *instance(int node);
+
+    explicit FFNodeAllocator(int node);
+    int getNode() const;
+
+protected:
+    virtual void *mapSlab(size_t size);
+
+private:
+    int m_node;
+};
+
+// per-session arena: pooled frame buffers(for frame2 and codec's get_buffer2),
+// which may outlive the arena when frames are still referenced.
+class FF_EXPORT FFArena {
+public:
+    FFArena();
+    virtual ~FFArena();
+
+    // allocator must be set before any allocation, NULL for FFSlabAllocator
+    void setAllocator(FFAllocator *allocator);
+
+    // pre-allocate frame buffers sized from format
+    long reserve(const FFVideoFormat &fmt, int count);
+
+    AVBufferRef *getBuffer(int size);
+    long allocFrame(AVFrame *frame);    // frame's format/width/height must be set
+    long attach(AVCodecContext *avctx); // use arena for decoder's frame buffers
+
+    int64_t getUsedBytes();     // bytes held by this session(in use and pooled)
+
+protected:
+    struct State;
+    static int getBuffer2(AVCodecContext *avctx, AVFrame *frame, int flags);
+    static void releaseBuffer(void *opaque, uint8_t *data);
+    static void releaseState(State *state);
+
+private:
+    State *m_state;
+};
+
+#endif // __FFALLOC_H_
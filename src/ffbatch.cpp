@@ -0,0 +1,131 @@
+#include "ffbatch.h"
+#include "ffencoder.h"
+#include "ffdecoder.h"
+#include "fflog.h"
+#include <map>
+
+// state of one batch call
+struct FFBatch::Call {
+    FFMutex mutex;
+    FFCond cond;
+    int pending;    // groups not finished
+    int failed;     // failed jobs
+};
+
+// jobs of one session
+struct FFBatch::Group {
+    Call *call;
+    void *jobs;
+    std::vector<int> indices;
+    int failed;
+};
+
+
+FFBatch::FFBatch() {
+}
+
+FFBatch::~FFBatch() {
+    close();
+}
+
+// return 0 if success, else < 0
+long FFBatch::open(int threads) {
+    returnv_if_fail(m_pool.size() == 0, 1); // opened
+    return m_pool.start(threads);
+}
+
+void FFBatch::close() {
+    m_pool.stop();
+}
+
+void FFBatch::finishGroup(Group *group) {
+    Call *call = group->call;
+    FFAutoLock lock(call->mutex);
+    call->failed += group->failed;
+    call->pending--;
+    if (call->pending == 0)
+        call->cond.signal();
+}
+
+void FFBatch::encodeTask(void *arg) {
+    Group *group = (Group *)arg;
+    FFEncodeJob *jobs = (FFEncodeJob *)group->jobs;
+    for (size_t i = 0; i < group->indices.size(); i++) {
+        FFEncodeJob &job = jobs[group->indices[i]];
+        job.result = job.encoder->encodeVideo(job.in_data, job.in_size, job.in_fmt, job.out_data, job.out_size);
+        if (job.result < 0)
+            group->failed++;
+    }
+    finishGroup(group);
+}
+
+void FFBatch::decodeTask(void *arg) {
+    Group *group = (Group *)arg;
+    FFDecodeJob *jobs = (FFDecodeJob *)group->jobs;
+    for (size_t i = 0; i < group->indices.size(); i++) {
+        FFDecodeJob &job = jobs[group->indices[i]];
+        job.result = job.decoder->decodeVideo(job.in_data, job.in_size, job.out_data, job.out_size, job.out_fmt);
+        if (job.result < 0)
+            group->failed++;
+    }
+    finishGroup(group);
+}
+
+// group jobs by session and run groups in pool, return 0 if all succeed, else < 0
+long FFBatch::run(void * const *sessions, int count, FFThreadPool::Task task, void *jobs) {
+    returnv_if_fail(m_pool.size() > 0, -1);
+
+    Call call;
+    call.pending = 0;
+    call.failed = 0;
+
+    std::vector<Group> groups;
+    std::map<void *, size_t> index;
+    for (int i = 0; i < count; i++) {
+        std::map<void *, size_t>::iterator iter = index.find(sessions[i]);
+        if (iter == index.end()) {
+            Group group;
+            group.call = &call;
+            group.jobs = jobs;
+            group.failed = 0;
+            iter = index.insert(std::make_pair(sessions[i], groups.size())).first;
+            groups.push_back(group);
+        }
+        groups[iter->second].indices.push_back(i);
+    }
+
+    call.pending = (int)groups.size();
+    for (size_t i = 0; i < groups.size(); i++) {
+        if (m_pool.post(task, &groups[i]) != 0) {
+            LOGE("fail to post batch group="<<i);
+            groups[i].failed = (int)groups[i].indices.size();
+            finishGroup(&groups[i]);
+        }
+    }
+
+    FFAutoLock lock(call.mutex);
+    while (call.pending > 0) {
+        call.cond.wait(call.mutex);
+    }
+    return call.failed == 0 ? 0 : -1;
+}
+
+long FFBatch::encodeVideo(FFEncodeJob *jobs, int count) {
+    returnv_if_fail(jobs && count > 0, -1);
+    std::vector<void *> sessions(count);
+    for (int i = 0; i < count; i++) {
+        returnv_if_fail(jobs[i].encoder, -1);
+        sessions[i] = jobs[i].encoder;
+    }
+    return run(&sessions[0], count, encodeTask, jobs);
+}
+
+long FFBatch::decodeVideo(FFDecodeJob *jobs, int count) {
+    returnv_if_fail(jobs && count > 0, -1);
+    std::vector<void *> sessions(count);
+    for (int i = 0; i < count; i++) {
+        returnv_if_fail(jobs[i].decoder, -1);
+        sessions[i] = jobs[i].decoder;
+    }
+    return run(&sessions[0], count, decodeTask, jobs);
+}
@@ -0,0 +1,81 @@
+#ifndef __FFBATCH_H_
+#define __FFBATCH_H_
+
+#include "ffparam.h"
+#include "ffthread.h"
+
+class FFEncoder;
+class FFDecoder;
+
+// one encodeVideo call of a session
+class FFEncodeJob {
+public:
+    FFEncodeJob() {
+        encoder = NULL;
+        in_data = NULL;
+        in_size = 0;
+        out_data = NULL;
+        out_size = 0;
+        result = -1;
+    }
+
+public:
+    FFEncoder *encoder;
+    const uint8_t *in_data;
+    int in_size;
+    FFVideoFormat in_fmt;
+    uint8_t *out_data;
+    int out_size;   // in: capacity, out: encoded size
+    long result;    // return of encodeVideo
+};
+
+// one decodeVideo call of a session
+class FFDecodeJob {
+public:
+    FFDecodeJob() {
+        decoder = NULL;
+        in_data = NULL;
+        in_size = 0;
+        out_data = NULL;
+        out_size = 0;
+        result = -1;
+    }
+
+public:
+    FFDecoder *decoder;
+    const uint8_t *in_data;
+    int in_size;
+    uint8_t *out_data;
+    int out_size;   // in: capacity, out: decoded size
+    FFVideoFormat out_fmt;
+    long result;    // return of decodeVideo
+};
+
+// run jobs of many sessions across threads in one call.
+// jobs of the same session run in array order on one thread.
+class FF_EXPORT FFBatch
+{
+public:
+    FFBatch();
+    virtual ~FFBatch();
+
+    long open(int threads);
+    void close();
+
+    // return 0 if all jobs succeed, else < 0 and check each job's result
+    long encodeVideo(FFEncodeJob *jobs, int count);
+    long decodeVideo(FFDecodeJob *jobs, int count);
+
+protected:
+    struct Call;
+    struct Group;
+    static void encodeTask(void *arg);
+    static void decodeTask(void *arg);
+    static void finishGroup(Group *group);
+    long run(void * const *sessions, int count, FFThreadPool::Task task, void *jobs);
+
+private:
+    FFThreadPool m_pool;
+};
+
+#endif // __FFBATCH_H_
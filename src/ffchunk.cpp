@@ -0,0 +1,251 @@
+#include "ffchunk.h"
+#include "ffencoder.h"
+#include "fflog.h"
+#include "ffcodec.h"
+
+struct FFChunkEncoder::Chunk {
+    FFChunkEncoder *owner;
+    FFVideoFormat in_fmt;
+    int frame_size;
+    int nb_frames;
+    int64_t first_frame;                // input index of the first frame
+    std::vector<uint8_t> frames;        // raw input frames
+    std::vector<uint8_t> output;        // encoded packets
+    std::vector<int> packet_sizes;
+    std::vector<FFTimeInfo> packet_infos;
+    bool done;
+    long result;
+};
+
+
+FFChunkEncoder::FFChunkEncoder() {
+    m_codec_id = FF_CODEC_ID_NONE;
+    m_vfmt.reset();
+    m_chunk_frames = 0;
+    m_window = 0;
+    m_callback = NULL;
+    m_opaque = NULL;
+    m_current = NULL;
+    m_nb_frames = 0;
+    m_error = 0;
+}
+
+FFChunkEncoder::~FFChunkEncoder() {
+    close();
+}
+
+// return 0 if success, else < 0
+long FFChunkEncoder::open(FFCodecID codec_id, const FFVideoFormat &format, int threads, int chunk_frames,
+        int window, FFChunkCallback callback, void *opaque) {
+    returnv_if_fail(m_pool.size() == 0, 1); // opened
+    returnv_if_fail(threads > 0 && chunk_frames > 0 && callback, -1);
+
+    long lret = m_pool.start(threads);
+    returnv_if_fail(lret == 0, -1);
+
+    m_codec_id = codec_id;
+    m_vfmt = format;
+    m_chunk_frames = chunk_frames;
+    m_window = (size_t)FFMAX(window, threads);
+    m_callback = callback;
+    m_opaque = opaque;
+    m_nb_frames = 0;
+    m_error = 0;
+    m_scene.reset();
+    return 0;
+}
+
+void FFChunkEncoder::close() {
+    // pending frames are encoded and output before stopping
+    if (m_pool.size() > 0 && m_error == 0) {
+        flush();
+    }
+    m_pool.stop();
+    while (!m_chunks.empty()) {
+        delete m_chunks.front();
+        m_chunks.pop_front();
+    }
+    safe_delete(m_current);
+    m_codec_id = FF_CODEC_ID_NONE;
+    m_vfmt.reset();
+    m_callback = NULL;
+    m_opaque = NULL;
+}
+
+// return 0 if success, else < 0
+long FFChunkEncoder::pushFrame(const uint8_t *in_data, const int in_size, const FFVideoFormat &in_fmt,
+        bool scene_cut) {
+    returnv_if_fail(m_pool.size() > 0, -1);
+    returnv_if_fail(in_data, -1);
+    returnv_if_fail(m_error == 0, m_error);
+
+    AVPixelFormat in_pix_fmt = GetAVPixelFormat(in_fmt.pix_fmt);
+    int frame_size = av_image_get_buffer_size(in_pix_fmt, in_fmt.width, in_fmt.height, 1);
+    returnv_if_fail(frame_size > 0 && frame_size <= in_size, -1);
+
+    if (m_vfmt.data.scene_detect &&
+            (in_fmt.pix_fmt == FF_PIX_FMT_I420 || in_fmt.pix_fmt == FF_PIX_FMT_NV21)) {
+        FFSceneInfo info;
+        if (m_scene.analyze(in_data, in_fmt.width, in_fmt.width, in_fmt.height, info) == 0)
+            scene_cut = scene_cut || info.scene_cut;
+    }
+
+    // cut chunk at scene change, chunk size or input format change
+    if (m_current && (scene_cut || m_current->nb_frames >= m_chunk_frames ||
+            m_current->frame_size != frame_size || m_current->in_fmt.pix_fmt != in_fmt.pix_fmt ||
+            m_current->in_fmt.width != in_fmt.width || m_current->in_fmt.height != in_fmt.height)) {
+        returnv_if_fail(dispatchChunk() == 0, -1);
+    }
+
+    if (!m_current) {
+        // keep the current one in window
+        returnv_if_fail(waitWindow(m_window - 1) == 0, m_error);
+
+        m_current = new Chunk;
+        m_current->owner = this;
+        m_current->in_fmt = in_fmt;
+        m_current->frame_size = frame_size;
+        m_current->nb_frames = 0;
+        m_current->first_frame = m_nb_frames;
+        m_current->frames.reserve((size_t)frame_size * m_chunk_frames);
+        m_current->done = false;
+        m_current->result = 0;
+    }
+
+    m_current->frames.insert(m_current->frames.end(), in_data, in_data + frame_size);
+    m_current->nb_frames++;
+    m_nb_frames++;
+
+    emitChunks();
+    return m_error;
+}
+
+// return 0 if success, else < 0
+long FFChunkEncoder::flush() {
+    returnv_if_fail(m_pool.size() > 0, -1);
+    if (m_current) {
+        returnv_if_fail(dispatchChunk() == 0, -1);
+    }
+    waitWindow(0);
+    return m_error;
+}
+
+long FFChunkEncoder::dispatchChunk() {
+    Chunk *chunk = m_current;
+    m_current = NULL;
+
+    m_mutex.lock();
+    m_chunks.push_back(chunk);
+    m_mutex.unlock();
+
+    long lret = m_pool.post(encodeTask, chunk);
+    if (lret != 0) {
+        FFAutoLock lock(m_mutex);
+        chunk->result = lret;
+        chunk->done = true;
+    }
+    return lret;
+}
+
+// wait until in-flight chunks <= limit, and emit finished ones meanwhile
+long FFChunkEncoder::waitWindow(size_t limit) {
+    for (;;) {
+        emitChunks();
+
+        FFAutoLock lock(m_mutex);
+        if (m_chunks.size() <= limit)
+            break;
+        if (!m_chunks.front()->done)
+            m_cond.wait(m_mutex);
+    }
+    return m_error;
+}
+
+// output finished chunks in order
+void FFChunkEncoder::emitChunks() {
+    for (;;) {
+        Chunk *chunk = NULL;
+        m_mutex.lock();
+        if (!m_chunks.empty() && m_chunks.front()->done) {
+            chunk = m_chunks.front();
+            m_chunks.pop_front();
+        }
+        m_mutex.unlock();
+        if (!chunk)
+            break;
+
+        if (chunk->result != 0) {
+            LOGE("fail to encode chunk, return="<<chunk->result);
+            m_error = chunk->result;
+        }
+        size_t offset = 0;
+        for (size_t i = 0; i < chunk->packet_sizes.size(); i++) {
+            m_callback(m_opaque, &chunk->output[offset], chunk->packet_sizes[i], chunk->packet_infos[i]);
+            offset += chunk->packet_sizes[i];
+        }
+        delete chunk;
+    }
+}
+
+void FFChunkEncoder::encodeTask(void *arg) {
+    Chunk *chunk = (Chunk *)arg;
+    FFChunkEncoder *self = chunk->owner;
+    long lret = self->encodeChunk(chunk);
+
+    FFAutoLock lock(self->m_mutex);
+    chunk->result = lret;
+    chunk->done = true;
+    self->m_cond.broadcast();
+}
+
+// encode one chunk by a new encoder, return 0 if success, else < 0
+long FFChunkEncoder::encodeChunk(Chunk *chunk) {
+    // independent chunk with in-band headers, to be concatenated
+    FFVideoFormat fmt = m_vfmt;
+    fmt.data.closed_gop = true;
+    fmt.data.global_header = false;
+    fmt.data.scene_detect = false; // chunks already start at cuts
+    if (fmt.data.thread_count <= 0) {
+        fmt.data.thread_count = 1;
+    }
+
+    FFEncoder encoder;
+    long lret = encoder.openVideo(m_codec_id, fmt);
+    returnv_if_fail(lret == 0, -1);
+
+    int capacity = av_image_get_buffer_size(AV_PIX_FMT_YUV420P, fmt.width, fmt.height, 1) * 2 + 4096;
+    std::vector<uint8_t> packet(capacity);
+    FFTimeInfo in_info, out_info;
+    for (int i = 0; i < chunk->nb_frames; i++) {
+        // encoder restarts at 0 for each chunk, so offset by the chunk's first frame
+        in_info.pts = chunk->first_frame + i;
+        int out_size = capacity;
+        lret = encoder.encodeVideo(&chunk->frames[(size_t)i * chunk->frame_size], chunk->frame_size,
+                chunk->in_fmt, in_info, &packet[0], out_size, out_info);
+        if (lret != 0) {
+            LOGE("fail to encode frame="<<i<<" of chunk, return="<<lret);
+            return lret;
+        }
+        if (out_size > 0) { // no output for delayed frames
+            chunk->output.insert(chunk->output.end(), packet.begin(), packet.begin() + out_size);
+            chunk->packet_sizes.push_back(out_size);
+            chunk->packet_infos.push_back(out_info);
+        }
+    }
+
+    // release input early, and drain delayed frames
+    std::vector<uint8_t>().swap(chunk->frames);
+    for (;;) {
+        int out_size = capacity;
+        lret = encoder.encodeVideo(NULL, 0, chunk->in_fmt, in_info, &packet[0], out_size, out_info);
+        returnv_if_fail(lret == 0, lret);
+        if (out_size <= 0)
+            break;
+        chunk->output.insert(chunk->output.end(), packet.begin(), packet.begin() + out_size);
+        chunk->packet_sizes.push_back(out_size);
+        chunk->packet_infos.push_back(out_info);
+    }
+
+    returnv_if_fail(!chunk->packet_sizes.empty(), -1);
+    return 0;
+}
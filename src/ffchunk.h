@@ -0,0 +1,59 @@
+#ifndef __FFCHUNK_H_
+#define __FFCHUNK_H_
+
+#include "ffparam.h"
+#include "ffthread.h"
+#include "ffscene.h"
+
+// called in output order, for each encoded packet.
+// info: pts/dts are input frame index over all chunks, and keyframe is set for chunk starts.
+typedef void (*FFChunkCallback)(void *opaque, const uint8_t *data, int size, const FFTimeInfo &info);
+
+// offline encoder: split input into independent chunks(closed gop) at scene cuts
+// or chunk_frames, encode chunks concurrently and output packets in order.
+class FF_EXPORT FFChunkEncoder
+{
+public:
+    FFChunkEncoder();
+    virtual ~FFChunkEncoder();
+
+    // threads: concurrent chunk encoders, window: max chunks in memory(>= threads)
+    long open(FFCodecID codec_id, const FFVideoFormat &format, int threads, int chunk_frames, int window,
+            FFChunkCallback callback, void *opaque);
+    void close();   // pending frames are flushed(and output) first, unless failed
+
+    // input frame is copied, and it may block when the window is full.
+    // scene cuts are also detected for I420/NV21 input if format.data.scene_detect.
+    long pushFrame(const uint8_t *in_data, const int in_size, const FFVideoFormat &in_fmt,
+            bool scene_cut = false);
+
+    // encode pending frames and wait for all outputs
+    long flush();
+
+protected:
+    struct Chunk;
+    static void encodeTask(void *arg);
+    long encodeChunk(Chunk *chunk);
+    long dispatchChunk();
+    long waitWindow(size_t limit);
+    void emitChunks();
+
+private:
+    FFCodecID m_codec_id;
+    FFVideoFormat m_vfmt;
+    int m_chunk_frames;
+    size_t m_window;
+    FFChunkCallback m_callback;
+    void *m_opaque;
+
+    FFThreadPool m_pool;
+    FFMutex m_mutex;
+    FFCond m_cond;
+    std::deque<Chunk *> m_chunks;   // dispatched chunks in order
+    Chunk *m_current;               // chunk being filled
+    int64_t m_nb_frames;            // input frames of all chunks
+    long m_error;
+    FFSceneDetector m_scene;
+};
+
+#endif // __FFCHUNK_H_
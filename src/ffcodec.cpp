@@ -1,109 +1,206 @@
 #include "ffcodec.h"
+#include "ffregistry.h"
 
-// for video pixel format
-typedef struct pix_fmt_entry_t {
-    enum FFPixelFormat pix_fmt;
-    enum AVPixelFormat av_pix_fmt;
-    int bpp;
-    const char *name;
-}pix_fmt_entry_t;
-const pix_fmt_entry_t k_pix_fmt_entries[] = {
-    { FF_PIX_FMT_NONE, AV_PIX_FMT_NONE, 0, "" },
-
-    { FF_PIX_FMT_I420,  AV_PIX_FMT_YUV420P,  12, "I420"  },
-    { FF_PIX_FMT_RGB24, AV_PIX_FMT_RGB24,    24, "RGB24" },
-    { FF_PIX_FMT_BGR24, AV_PIX_FMT_BGR24,    24, "BGR24" },
-    { FF_PIX_FMT_NV21,  AV_PIX_FMT_NV21,     12, "NV21"  },
-};
-
-// for video codec id
-typedef struct codec_id_entry_t {
-    enum FFCodecID codec_id;
-    enum AVCodecID av_codec_id;
-    const char *fourcc;
-}codec_id_entry_t;
-const codec_id_entry_t k_codec_id_entries[] = {
-    { FF_CODEC_ID_MP2,  AV_CODEC_ID_MP2,  "mp2 " },
-    { FF_CODEC_ID_OPUS, AV_CODEC_ID_OPUS, "opus" },
-    { FF_CODEC_ID_H264, AV_CODEC_ID_H264, "h264" },
-    { FF_CODEC_ID_VP8,  AV_CODEC_ID_VP8,  "vp8" },
-};
-
-// for audio sample format
-typedef struct sample_fmt_entry_t {
-    enum FFSampleFormat sample_fmt;
-    enum AVSampleFormat av_sample_fmt; 
-    const char *fmt_be, *fmt_le;
-} sample_fmt_entry_t;
-const sample_fmt_entry_t k_sample_fmt_entries[] = {
-    { FF_SAMPLE_FMT_NONE, AV_SAMPLE_FMT_NONE, "", ""},
-
-    { FF_SAMPLE_FMT_U8,  AV_SAMPLE_FMT_U8,  "u8",    "u8"    },
-    { FF_SAMPLE_FMT_S16, AV_SAMPLE_FMT_S16, "s16be", "s16le" },
-    { FF_SAMPLE_FMT_S32, AV_SAMPLE_FMT_S32, "s32be", "s32le" },
-    { FF_SAMPLE_FMT_FLT, AV_SAMPLE_FMT_FLT, "f32be", "f32le" },
-    { FF_SAMPLE_FMT_DBL, AV_SAMPLE_FMT_DBL, "f64be", "f64le" },
-
-    { FF_SAMPLE_FMT_U8P,  AV_SAMPLE_FMT_U8P,  "u8p",    "u8p"    },
-    { FF_SAMPLE_FMT_S16P, AV_SAMPLE_FMT_S16P, "s16pbe", "s16ple" },
-    { FF_SAMPLE_FMT_S32P, AV_SAMPLE_FMT_S32P, "s32pbe", "s32ple" },
-    { FF_SAMPLE_FMT_FLTP, AV_SAMPLE_FMT_FLTP, "f32pbe", "f32ple" },
-    { FF_SAMPLE_FMT_DBLP, AV_SAMPLE_FMT_DBLP, "f64pbe", "f64ple" },
-};
-
+// lookups are switches generated from registry(compiled into jump tables)
+#define PIX_FMT_TO_AV(ff, av, bits, nb_planes, str)     case ff: return av;
+#define PIX_FMT_FROM_AV(ff, av, bits, nb_planes, str)   case av: return ff;
+#define PIX_FMT_BITS(ff, av, bits, nb_planes, str)      case ff: return bits;
+#define PIX_FMT_PLANES(ff, av, bits, nb_planes, str)    case ff: return nb_planes;
+#define CODEC_ID_TO_AV(ff, av, type, str)               case ff: return av;
+#define CODEC_ID_FROM_AV(ff, av, type, str)             case av: return ff;
+#define CODEC_ID_FOURCC(ff, av, type, str)              case ff: return str;
+#define CODEC_ID_MEDIA_TYPE(ff, av, type, str)          case ff: return type;
+#define SAMPLE_FMT_TO_AV(ff, av, nb_bytes, is_planar, str_be, str_le)   case ff: return av;
+#define SAMPLE_FMT_FROM_AV(ff, av, nb_bytes, is_planar, str_be, str_le) case av: return ff;
 
 AVPixelFormat GetAVPixelFormat(FFPixelFormat pix_fmt) {
-    for (int i = 0; i < FF_ARRAY_ELEMS(k_pix_fmt_entries); i++) {
-        const struct pix_fmt_entry_t *entry = &k_pix_fmt_entries[i];
-        if (pix_fmt == entry->pix_fmt)
-            return entry->av_pix_fmt;
+    switch(pix_fmt) {
+        FF_PIX_FMT_REGISTRY(PIX_FMT_TO_AV)
+        default: return AV_PIX_FMT_NONE;
     }
-    return AV_PIX_FMT_NONE;
 }
 
 FFPixelFormat GetFFPixelFormat(AVPixelFormat pix_fmt) {
-    for (int i = 0; i < FF_ARRAY_ELEMS(k_pix_fmt_entries); i++) {
-        const struct pix_fmt_entry_t *entry = &k_pix_fmt_entries[i];
-        if (pix_fmt == entry->av_pix_fmt)
-            return entry->pix_fmt;
+    switch(pix_fmt) {
+        FF_PIX_FMT_REGISTRY(PIX_FMT_FROM_AV)
+        default: return FF_PIX_FMT_NONE;
+    }
+}
+
+int GetPixelBits(FFPixelFormat pix_fmt) {
+    switch(pix_fmt) {
+        FF_PIX_FMT_REGISTRY(PIX_FMT_BITS)
+        default: return 0;
+    }
+}
+
+int GetPixelPlanes(FFPixelFormat pix_fmt) {
+    switch(pix_fmt) {
+        FF_PIX_FMT_REGISTRY(PIX_FMT_PLANES)
+        default: return 0;
     }
-    return FF_PIX_FMT_NONE;
 }
 
 AVCodecID GetAVCodecID(FFCodecID codec_id) {
-    for (int i = 0; i < FF_ARRAY_ELEMS(k_codec_id_entries); i++) {
-        const struct codec_id_entry_t *entry = &k_codec_id_entries[i];
-        if (codec_id == entry->codec_id)
-            return entry->av_codec_id;
+    switch(codec_id) {
+        FF_CODEC_ID_REGISTRY(CODEC_ID_TO_AV)
+        default: return AV_CODEC_ID_NONE;
     }
-    return AV_CODEC_ID_NONE;
 }
 
 FFCodecID GetFFCodecID(AVCodecID codec_id) {
-    for (int i = 0; i < FF_ARRAY_ELEMS(k_codec_id_entries); i++) {
-        const struct codec_id_entry_t *entry = &k_codec_id_entries[i];
-        if (codec_id == entry->av_codec_id)
-            return entry->codec_id;
+    switch(codec_id) {
+        FF_CODEC_ID_REGISTRY(CODEC_ID_FROM_AV)
+        default: return FF_CODEC_ID_NONE;
+    }
+}
+
+const char *GetCodecFourcc(FFCodecID codec_id) {
+    switch(codec_id) {
+        FF_CODEC_ID_REGISTRY(CODEC_ID_FOURCC)
+        default: return "    ";
+    }
+}
+
+FFMediaType GetCodecMediaType(FFCodecID codec_id) {
+    switch(codec_id) {
+        FF_CODEC_ID_REGISTRY(CODEC_ID_MEDIA_TYPE)
+        default: return FF_MEDIA_VIDEO;
     }
-    return FF_CODEC_ID_NONE;
 }
 
 AVSampleFormat GetAVSampleFormat(FFSampleFormat sample_fmt) {
-    for (int i = 0; i < FF_ARRAY_ELEMS(k_sample_fmt_entries); i++) {
-        const struct sample_fmt_entry_t *entry = &k_sample_fmt_entries[i];
-        if (sample_fmt == entry->sample_fmt)
-            return entry->av_sample_fmt;
+    switch(sample_fmt) {
+        FF_SAMPLE_FMT_REGISTRY(SAMPLE_FMT_TO_AV)
+        default: return AV_SAMPLE_FMT_NONE;
     }
-    return AV_SAMPLE_FMT_NONE;
 }
 
 FFSampleFormat GetFFSampleFormat(AVSampleFormat sample_fmt) {
-    for (int i = 0; i < FF_ARRAY_ELEMS(k_sample_fmt_entries); i++) {
-        const struct sample_fmt_entry_t *entry = &k_sample_fmt_entries[i];
-        if (sample_fmt == entry->av_sample_fmt)
-            return entry->sample_fmt;
+    switch(sample_fmt) {
+        FF_SAMPLE_FMT_REGISTRY(SAMPLE_FMT_FROM_AV)
+        default: return FF_SAMPLE_FMT_NONE;
     }
-    return FF_SAMPLE_FMT_NONE;
+}
+
+
+// specialized converters of same-size frames, NULL for others(by sws)
+template <int S, int D>
+struct pix_converter {
+    static ff_convert_func get() { return NULL; }
+};
+
+template <int F>
+struct pix_converter<F, F> {
+    static void convert(const uint8_t *const src[4], const int src_linesize[4],
+            uint8_t *const dst[4], const int dst_linesize[4], int width, int height) {
+        av_image_copy((uint8_t **)dst, (int *)dst_linesize, (const uint8_t **)src, src_linesize,
+                pix_fmt_traits<F>::av_pix_fmt, width, height);
+    }
+    static ff_convert_func get() { return convert; }
+};
+
+template <>
+struct pix_converter<FF_PIX_FMT_I420, FF_PIX_FMT_NV21> {
+    static void convert(const uint8_t *const src[4], const int src_linesize[4],
+            uint8_t *const dst[4], const int dst_linesize[4], int width, int height) {
+        av_image_copy_plane(dst[0], dst_linesize[0], src[0], src_linesize[0], width, height);
+        int cw = (width + 1) >> 1, ch = (height + 1) >> 1;
+        for (int y = 0; y < ch; y++) {
+            const uint8_t *u = src[1] + y * src_linesize[1];
+            const uint8_t *v = src[2] + y * src_linesize[2];
+            uint8_t *vu = dst[1] + y * dst_linesize[1];
+            for (int x = 0; x < cw; x++) {
+                vu[2*x] = v[x];
+                vu[2*x+1] = u[x];
+            }
+        }
+    }
+    static ff_convert_func get() { return convert; }
+};
+
+template <>
+struct pix_converter<FF_PIX_FMT_NV21, FF_PIX_FMT_I420> {
+    static void convert(const uint8_t *const src[4], const int src_linesize[4],
+            uint8_t *const dst[4], const int dst_linesize[4], int width, int height) {
+        av_image_copy_plane(dst[0], dst_linesize[0], src[0], src_linesize[0], width, height);
+        int cw = (width + 1) >> 1, ch = (height + 1) >> 1;
+        for (int y = 0; y < ch; y++) {
+            const uint8_t *vu = src[1] + y * src_linesize[1];
+            uint8_t *u = dst[1] + y * dst_linesize[1];
+            uint8_t *v = dst[2] + y * dst_linesize[2];
+            for (int x = 0; x < cw; x++) {
+                v[x] = vu[2*x];
+                u[x] = vu[2*x+1];
+            }
+        }
+    }
+    static ff_convert_func get() { return convert; }
+};
+
+// rgb24 <=> bgr24 is the same swap of R and B
+static void swap_rb24(const uint8_t *const src[4], const int src_linesize[4],
+        uint8_t *const dst[4], const int dst_linesize[4], int width, int height) {
+    for (int y = 0; y < height; y++) {
+        const uint8_t *s = src[0] + y * src_linesize[0];
+        uint8_t *d = dst[0] + y * dst_linesize[0];
+        for (int x = 0; x < width; x++, s += 3, d += 3) {
+            uint8_t r = s[0];
+            d[0] = s[2];
+            d[1] = s[1];
+            d[2] = r;
+        }
+    }
+}
+
+template <>
+struct pix_converter<FF_PIX_FMT_RGB24, FF_PIX_FMT_BGR24> {
+    static ff_convert_func get() { return swap_rb24; }
+};
+
+template <>
+struct pix_converter<FF_PIX_FMT_BGR24, FF_PIX_FMT_RGB24> {
+    static ff_convert_func get() { return swap_rb24; }
+};
+
+// fill table[S][D] for all registered pairs
+template <int S, int D>
+struct pix_converter_table {
+    static void fill(ff_convert_func table[FF_PIX_FMT_NB][FF_PIX_FMT_NB]) {
+        table[S][D] = pix_converter<S, D>::get();
+        pix_converter_table<S, D + 1>::fill(table);
+    }
+};
+template <int S>
+struct pix_converter_table<S, FF_PIX_FMT_NB> {
+    static void fill(ff_convert_func table[FF_PIX_FMT_NB][FF_PIX_FMT_NB]) {
+        pix_converter_table<S + 1, 0>::fill(table);
+    }
+};
+template <>
+struct pix_converter_table<FF_PIX_FMT_NB, 0> {
+    static void fill(ff_convert_func [FF_PIX_FMT_NB][FF_PIX_FMT_NB]) {} // end of table
+};
+
+struct pix_converter_registry {
+    pix_converter_registry() {
+        pix_converter_table<0, 0>::fill(table);
+    }
+    ff_convert_func table[FF_PIX_FMT_NB][FF_PIX_FMT_NB];
+};
+static const pix_converter_registry k_pix_converters;
+
+ff_convert_func GetPixelConverter(FFPixelFormat src_fmt, FFPixelFormat dst_fmt) {
+    if (src_fmt < 0 || src_fmt >= FF_PIX_FMT_NB || dst_fmt < 0 || dst_fmt >= FF_PIX_FMT_NB)
+        return NULL;
+    return k_pix_converters.table[src_fmt][dst_fmt];
+}
+
+void GetFrameTimeInfo(const AVFrame *frame, FFTimeInfo &info) {
+    info.pts = av_frame_get_best_effort_timestamp(frame);
+    info.dts = frame->pkt_dts;
+    info.opaque = frame->reordered_opaque;
+    info.keyframe = frame->key_frame != 0;
 }
 
 
@@ -205,3 +302,22 @@ AVPixelFormat select_pix_fmt(AVCodec *codec)
     return *p;
 }
 
+
+
+/* offset of the next annex-b start code(3 or 4 bytes) from pos, or size if none */
+int find_start_code(const uint8_t *data, int size, int pos)
+{
+    for (int i = pos; i + 3 <= size; i++) {
+        if (data[i] == 0 && data[i+1] == 0 && data[i+2] == 1)
+            return (i > pos && data[i-1] == 0) ? i - 1 : i;
+    }
+    return size;
+}
+
+/* offset of the nal unit after the start code at pos */
+int skip_start_code(const uint8_t *data, int size, int pos)
+{
+    while (pos < size && data[pos] == 0)
+        pos++;
+    return FFMIN(pos + 1, size);
+}
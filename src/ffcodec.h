@@ -2,6 +2,7 @@
 #define __FFCODEC_H_
 
 #include "ffparam.h"
+#include "ffalloc.h"
 
 class FFCodec {
 public:
@@ -17,8 +18,7 @@ public:
     virtual ~FFCodec() {
         codec = NULL;
         if (avctx) {
-            avcodec_close(avctx);
-            av_free(avctx);
+            avcodec_free_context(&avctx); // also free extradata
             avctx = NULL;
         }
         if (frame) {
@@ -44,6 +44,7 @@ public:
     AVFrame  *frame2;   // for self-allocated buffer
     AVPacket avpkt;
     SwsContext *swsctx;
+    FFArena arena;      // for frame buffers of this session
 };
 
 
@@ -55,10 +56,21 @@ FFPixelFormat GetFFPixelFormat(AVPixelFormat pix_fmt);
 
 AVCodecID GetAVCodecID(FFCodecID codec_id);
 FFCodecID GetFFCodecID(AVCodecID codec_id);
+const char *GetCodecFourcc(FFCodecID codec_id);
+FFMediaType GetCodecMediaType(FFCodecID codec_id);
 
 AVSampleFormat GetAVSampleFormat(FFSampleFormat fmt);
 FFSampleFormat GetFFSampleFormat(AVSampleFormat fmt);
 
+int GetPixelBits(FFPixelFormat pix_fmt);
+int GetPixelPlanes(FFPixelFormat pix_fmt);
+
+// converter of same-size frames, NULL if not specialized(use sws)
+ff_convert_func GetPixelConverter(FFPixelFormat src_fmt, FFPixelFormat dst_fmt);
+
+// timestamps and user data of decoded frame
+void GetFrameTimeInfo(const AVFrame *frame, FFTimeInfo &info);
+
 // for audio codec
 int check_sample_fmt(AVCodec *codec, enum AVSampleFormat sample_fmt);
 AVSampleFormat select_sample_fmt(AVCodec *codec);
@@ -70,6 +82,10 @@ int select_sample_rate(AVCodec *codec);
 int check_pix_fmt(AVCodec *codec, enum AVPixelFormat pix_fmt);
 AVPixelFormat select_pix_fmt(AVCodec *codec);
 
+// for annex-b bitstream
+int find_start_code(const uint8_t *data, int size, int pos);
+int skip_start_code(const uint8_t *data, int size, int pos);
+
 
 #endif // __FFCODEC_H_
 
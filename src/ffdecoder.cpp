@@ -1,11 +1,90 @@
 #include "ffdecoder.h"
 #include "fflog.h"
 #include "ffcodec.h"
+#include "ffframe.h"
+#include "ffalloc.h"
+#include "ffthread.h"
+#include "ffinspect.h"
+
+// for decode quality
+typedef struct decode_quality_entry_t {
+    enum FFDecodeQuality quality;
+    enum AVDiscard skip_loop_filter;
+    enum AVDiscard skip_idct;
+    enum AVDiscard skip_frame;
+}decode_quality_entry_t;
+const decode_quality_entry_t k_decode_quality_entries[] = {
+    { FF_DECODE_QUALITY_FULL,  AVDISCARD_DEFAULT, AVDISCARD_DEFAULT, AVDISCARD_DEFAULT },
+    { FF_DECODE_QUALITY_FAST,  AVDISCARD_NONREF,  AVDISCARD_NONREF,  AVDISCARD_DEFAULT },
+    { FF_DECODE_QUALITY_NOREF, AVDISCARD_ALL,     AVDISCARD_NONREF,  AVDISCARD_NONREF  },
+    { FF_DECODE_QUALITY_KEY,   AVDISCARD_ALL,     AVDISCARD_DEFAULT, AVDISCARD_NONKEY  },
+};
+
+
+// the governor checks budget per window(1s):
+// raise one level if overrun, and fall back one level if under 60% of budget.
+#define GOVERNOR_WINDOW 1000000
+static FFMutex s_gov_mutex;
+static int64_t s_gov_budget = 0;
+static int64_t s_gov_used = 0;
+static int64_t s_gov_start = 0;
+static FFDecodeQuality s_gov_quality = FF_DECODE_QUALITY_FULL;
+
+void FFDecodeGovernor::setBudget(int64_t budget) {
+    FFAutoLock lock(s_gov_mutex);
+    s_gov_budget = budget;
+    s_gov_used = 0;
+    s_gov_start = av_gettime_relative();
+    if (budget <= 0)
+        s_gov_quality = FF_DECODE_QUALITY_FULL;
+}
+
+int64_t FFDecodeGovernor::getBudget() {
+    FFAutoLock lock(s_gov_mutex);
+    return s_gov_budget;
+}
+
+void FFDecodeGovernor::report(int64_t usec) {
+    FFAutoLock lock(s_gov_mutex);
+    if (s_gov_budget > 0) {
+        s_gov_used += usec;
+        int64_t now = av_gettime_relative();
+        int64_t elapsed = now - s_gov_start;
+        if (elapsed >= GOVERNOR_WINDOW) {
+            int64_t budget = s_gov_budget * elapsed / GOVERNOR_WINDOW;
+            int level = s_gov_quality;
+            if (s_gov_used > budget && level < FF_DECODE_QUALITY_NB - 1) {
+                level++;
+            }else if (s_gov_used * 10 < budget * 6 && level > FF_DECODE_QUALITY_FULL) {
+                level--;
+            }
+            if (level != s_gov_quality) {
+                LOGI("decode quality changes to "<<level<<", used="<<s_gov_used<<", budget="<<budget);
+                s_gov_quality = (FFDecodeQuality)level;
+            }
+            s_gov_used = 0;
+            s_gov_start = now;
+        }
+    }
+}
+
+FFDecodeQuality FFDecodeGovernor::getQuality() {
+    FFAutoLock lock(s_gov_mutex);
+    return s_gov_quality;
+}
+
 
 FFDecoder::FFDecoder() {
     m_video = NULL;
     m_audio = NULL;
     m_vfmt.reset();
+    m_vpolicy.reset();
+    m_vquality = FF_DECODE_QUALITY_FULL;
+    m_vdelay = 0;
+    m_thumb_lowres = 0;
+    m_ofmt.reset();
+    m_out_pix_fmt = AV_PIX_FMT_NONE;
+    memset(m_out_linesize, 0, sizeof(m_out_linesize));
 }
 
 FFDecoder::~FFDecoder() {
@@ -13,7 +92,7 @@ FFDecoder::~FFDecoder() {
     closeAudio();
 }
 
-long FFDecoder::openCodec(ff_codec_t codec, FFCodecID codec_id) {
+long FFDecoder::openCodec(ff_codec_t codec, FFCodecID codec_id, const uint8_t *extradata, int extradata_size) {
     FFCodec *pCodec = (FFCodec *)codec;
     returnv_if_fail(pCodec, -1);
 
@@ -26,23 +105,124 @@ long FFDecoder::openCodec(ff_codec_t codec, FFCodecID codec_id) {
     pCodec->avctx = avcodec_alloc_context3(pCodec->codec);
     returnv_if_fail(pCodec->avctx, -1);
 
-    int iret = avcodec_open2(pCodec->avctx, pCodec->codec, NULL);
+    // codec specific data from container(e.g. avcC)
+    if (extradata && extradata_size > 0) {
+        pCodec->avctx->extradata = (uint8_t *)av_mallocz(extradata_size + AV_INPUT_BUFFER_PADDING_SIZE);
+        returnv_if_fail(pCodec->avctx->extradata, -1);
+        memcpy(pCodec->avctx->extradata, extradata, extradata_size);
+        pCodec->avctx->extradata_size = extradata_size;
+    }
+
+    // lowres must be set before opening, and frame buffers are from arena
+    if (pCodec->mtype == FF_MEDIA_VIDEO) {
+        pCodec->arena.attach(pCodec->avctx);
+        pCodec->avctx->refcounted_frames = 1; // frames may be shared by FFFrame
+        pCodec->avctx->lowres = FFMAX(0, FFMIN(m_vpolicy.lowres, pCodec->codec->max_lowres));
+        if (m_vpolicy.threads > 0) {
+            pCodec->avctx->thread_count = m_vpolicy.threads;
+            pCodec->avctx->thread_type = m_vpolicy.frame_threads ? (FF_THREAD_FRAME | FF_THREAD_SLICE) : FF_THREAD_SLICE;
+        }
+    }
+
+    int iret = -1;
+    {
+        // codec threads inherit affinity of opening thread
+        FFPlaceGuard guard(pCodec->mtype == FF_MEDIA_VIDEO ? m_vplace : FFPlacement());
+        iret = avcodec_open2(pCodec->avctx, pCodec->codec, NULL);
+    }
     returnv_if_fail(iret == 0, -1);
 
-    pCodec->frame = av_frame_alloc();
+    if (!pCodec->frame)
+        pCodec->frame = av_frame_alloc();
     av_init_packet(&pCodec->avpkt);
     return 0;
 }
 
-long FFDecoder::openVideo(FFCodecID codec_id) {
+// apply decode policy to video context, return 0 if success, else < 0
+long FFDecoder::applyVideoPolicy() {
+    FFCodec *pCodec = (FFCodec *)m_video;
+    returnv_if_fail(pCodec && pCodec->avctx, -1);
+
+    // lowres can only be changed by reopening codec
+    int lowres = FFMAX(0, FFMIN(m_vpolicy.lowres, pCodec->codec->max_lowres));
+    if (lowres != pCodec->avctx->lowres) {
+        FFCodecID codec_id = GetFFCodecID(pCodec->avctx->codec_id);
+        uint8_t *extradata = pCodec->avctx->extradata;
+        int extradata_size = pCodec->avctx->extradata_size;
+        pCodec->avctx->extradata = NULL;
+        pCodec->avctx->extradata_size = 0;
+        avcodec_free_context(&pCodec->avctx);
+        m_vfmt.reset();
+        m_vquality = FF_DECODE_QUALITY_FULL;
+        m_vdelay = 0; // pending frames are dropped
+
+        long lret = openCodec(m_video, codec_id, extradata, extradata_size);
+        av_free(extradata);
+        if (lret != 0) {
+            LOGE("fail to reopen with lowres="<<lowres<<", return="<<lret);
+            return lret;
+        }
+    }
+
+    FFDecodeQuality quality = m_vpolicy.quality;
+    if (quality == FF_DECODE_QUALITY_AUTO)
+        quality = FFDecodeGovernor::getQuality();
+    if (quality != m_vquality && quality >= 0 && quality < FF_DECODE_QUALITY_NB) {
+        const struct decode_quality_entry_t *entry = &k_decode_quality_entries[quality];
+        pCodec->avctx->skip_loop_filter = entry->skip_loop_filter;
+        pCodec->avctx->skip_idct = entry->skip_idct;
+        pCodec->avctx->skip_frame = entry->skip_frame;
+        m_vquality = quality;
+    }
+    return 0;
+}
+
+// pre-allocate frame buffers for the expected stream format, return 0 if success, else < 0
+long FFDecoder::reserveVideo(const FFVideoFormat &fmt, int frames) {
+    returnv_if_fail(m_video, -1);
+    return ((FFCodec *)m_video)->arena.reserve(fmt, frames);
+}
+
+// bytes of frame buffers held by video and audio sessions
+int64_t FFDecoder::getMemoryUsage() {
+    int64_t bytes = 0;
+    if (m_video)
+        bytes += ((FFCodec *)m_video)->arena.getUsedBytes();
+    if (m_audio)
+        bytes += ((FFCodec *)m_audio)->arena.getUsedBytes();
+    return bytes;
+}
+
+// take effect from next decodeVideo
+void FFDecoder::setVideoPolicy(const FFDecodePolicy &policy) {
+    m_vpolicy = policy;
+}
+
+const FFDecodePolicy &FFDecoder::getVideoPolicy() const {
+    return m_vpolicy;
+}
+
+long FFDecoder::openVideo(FFCodecID codec_id, const uint8_t *extradata, int extradata_size) {
     returnv_if_fail(!m_video, 1); // has been opened
     m_video = (ff_codec_t)new FFCodec(FF_MEDIA_VIDEO);
     returnv_if_fail(m_video, -1);
     m_vfmt.reset();
+    m_vquality = FF_DECODE_QUALITY_FULL;
 
-    long lret = openCodec(m_video, codec_id);
+    m_vplace = m_placement;
+    if (m_vplace.node != FF_NODE_NONE || !m_vplace.cpus.empty()) {
+        if (FFPlacer::acquire(m_vplace) == 0) {
+            if (m_vplace.node >= 0) // no node allocator for cpus only
+                ((FFCodec *)m_video)->arena.setAllocator(FFNodeAllocator::instance(m_vplace.node));
+        }else {
+            LOGW("fail to place on node="<<m_placement.node<<", and run unplaced");
+            m_vplace.reset();
+        }
+    }
+
+    long lret = openCodec(m_video, codec_id, extradata, extradata_size);
     if (lret != 0) {
-        safe_delete_codec(m_video);
+        closeVideo();
         LOGE("fail to open ff_codec_id="<<codec_id<<", return=" << lret);
     }
     return lret;
@@ -50,13 +230,26 @@ long FFDecoder::openVideo(FFCodecID codec_id) {
 void FFDecoder::closeVideo() {
     safe_delete_codec(m_video);
     m_vfmt.reset();
+    m_vdelay = 0;
+    m_thumb_lowres = 0;
+    if (m_vplace.node >= 0)
+        FFPlacer::release(m_vplace);
+    m_vplace.reset();
+}
+
+void FFDecoder::setPlacement(const FFPlacement &placement) {
+    m_placement = placement;
 }
 
-long FFDecoder::openAudio(FFCodecID codec_id) {
+const FFPlacement &FFDecoder::getPlacement() const {
+    return m_vplace;
+}
+
+long FFDecoder::openAudio(FFCodecID codec_id, const uint8_t *extradata, int extradata_size) {
     returnv_if_fail(!m_audio, 1); // had been opened
     m_audio = (ff_codec_t)new FFCodec(FF_MEDIA_AUDIO);
     returnv_if_fail(m_audio, -1);
-    long lret = openCodec(m_audio, codec_id);
+    long lret = openCodec(m_audio, codec_id, extradata, extradata_size);
     if (lret != 0) {
         safe_delete_codec(m_audio);
         LOGE("fail to open ff_codec_id="<<codec_id<<", return=" << lret);
@@ -67,76 +260,264 @@ void FFDecoder::closeAudio() {
     safe_delete_codec(m_audio);
 }
 
-// return consumed bytes(>0) if success, else < 0
-long FFDecoder::decodeVideo(const uint8_t *in_data, int in_size, uint8_t *out_data, int &out_size, 
-        const FFVideoFormat &out_fmt) {
-    returnv_if_fail(m_video, -1);
-    returnv_if_fail(out_data, -1);
+// prepare output(linesize and buffer), return actual output size if success, else < 0
+long FFDecoder::prepareVideo(const FFVideoFormat &out_fmt, uint8_t *out_data, int out_size,
+        uint8_t *dst_data[4], int dst_linesize[4]) {
+    // check output format only when it changes
+    if (m_ofmt.width != out_fmt.width ||
+        m_ofmt.height != out_fmt.height ||
+        m_ofmt.pix_fmt != out_fmt.pix_fmt) 
+    {
+        m_ofmt.reset();
+        AVPixelFormat out_pix_fmt = GetAVPixelFormat(out_fmt.pix_fmt);
+        if (out_pix_fmt == AV_PIX_FMT_NONE) {
+            LOGE("unsupported output ff_pix_fmt="<<out_fmt.pix_fmt);
+            return -1;
+        }
 
-    // required output format
-    int out_width = out_fmt.width;
-    int out_height = out_fmt.height;
-    AVPixelFormat out_pix_fmt = GetAVPixelFormat(out_fmt.pix_fmt);
-    if (out_pix_fmt == AV_PIX_FMT_NONE) {
-        LOGE("unsupported output ff_pix_fmt="<<out_fmt.pix_fmt);
-        return -1;
+        if (!sws_isSupportedOutput(out_pix_fmt)) {
+            LOGE("(sws) unsupported output ff_pix_fmt="<<out_fmt.pix_fmt<<", pix_fmt="<<out_pix_fmt);
+            return -1;
+        }
+
+        int iret = av_image_fill_linesizes(m_out_linesize, out_pix_fmt, out_fmt.width);
+        returnv_if_fail(iret >= 0, -1);
+        m_out_pix_fmt = out_pix_fmt;
+        m_ofmt = out_fmt;
     }
 
+    memcpy(dst_linesize, m_out_linesize, sizeof(m_out_linesize));
+    int iret = av_image_fill_pointers(dst_data, m_out_pix_fmt, out_fmt.height, out_data, dst_linesize);
+    returnv_if_fail(iret > 0 && iret <= out_size, -1);
+    return iret;
+}
+
+// convert decoded frame into output, return 0 if success, else < 0
+long FFDecoder::scaleVideo(const FFVideoFormat &out_fmt, uint8_t *dst_data[4], int dst_linesize[4], 
+        int sws_flags) {
     FFCodec *pCodec = (FFCodec *)m_video;
-    if (!sws_isSupportedOutput(out_pix_fmt)) {
-        LOGE("(sws) unsupported output ff_pix_fmt="<<out_fmt.pix_fmt<<", pix_fmt="<<out_pix_fmt);
-        return -1;
+
+    // prepare sws convert, check decoded format only when it changes
+    FFPixelFormat avctx_pix_fmt = GetFFPixelFormat(pCodec->avctx->pix_fmt);
+    if (m_vfmt.width != pCodec->avctx->width ||
+        m_vfmt.height != pCodec->avctx->height ||
+        m_vfmt.pix_fmt != avctx_pix_fmt) 
+    {
+        if (!sws_isSupportedInput(pCodec->avctx->pix_fmt)) {
+            LOGE("(sws) unsupported decoded pix_fmt="<<pCodec->avctx->pix_fmt);
+            return -1;
+        }
+        m_vfmt.width = pCodec->avctx->width;
+        m_vfmt.height = pCodec->avctx->height;
+        m_vfmt.pix_fmt = avctx_pix_fmt;
     }
 
-    // prepare output(linesize and buffer)
-    int dst_linesize[4] = { 0 };
-    int iret = av_image_fill_linesizes(dst_linesize, out_pix_fmt, out_width);
-    returnv_if_fail(iret >= 0, -1);
+    // specialized converter for same size, else sws
+    AVFrame *frame = pCodec->frame;
+    if (out_fmt.width == frame->width && out_fmt.height == frame->height) {
+        ff_convert_func convert = GetPixelConverter(avctx_pix_fmt, out_fmt.pix_fmt);
+        if (convert) {
+            convert(frame->data, frame->linesize, dst_data, dst_linesize, frame->width, frame->height);
+            return 0;
+        }
+    }
 
-    uint8_t *dst_data[4] = { 0 };
-    iret = av_image_fill_pointers(dst_data, out_pix_fmt, out_height, out_data, dst_linesize);
-    returnv_if_fail(iret > 0 && iret <= out_size, -1);
-    out_size = iret; // actual output size if success
+    // reuse sws context unless input/output format changes
+    pCodec->swsctx = sws_getCachedContext(pCodec->swsctx, 
+            pCodec->avctx->width, pCodec->avctx->height, pCodec->avctx->pix_fmt,
+            out_fmt.width, out_fmt.height, m_out_pix_fmt, sws_flags,
+            NULL, NULL, NULL);
+    returnv_if_fail(pCodec->swsctx, -1);
+
+    // sws convert
+    int iret = sws_scale(pCodec->swsctx, pCodec->frame->data, pCodec->frame->linesize, 0, pCodec->frame->height,
+            dst_data, dst_linesize);
+    returnv_if_fail(iret == out_fmt.height, -1); // height of output slice
+    return 0;
+}
+
+// whether packet is skipped by decoder for skip_frame(decode quality or thumbnail),
+// which then never outputs a frame
+bool FFDecoder::isDiscarded(const uint8_t *in_data, const int in_size) {
+    AVCodecContext *avctx = ((FFCodec *)m_video)->avctx;
+    if (avctx->skip_frame >= AVDISCARD_ALL)
+        return true;
+    if (avctx->skip_frame < AVDISCARD_NONREF)
+        return false;
+
+    FFPacketInfo info;
+    if (FFPacketInspector::inspect(GetFFCodecID(avctx->codec_id), in_data, in_size, info) != 0)
+        return false;
+    if (avctx->skip_frame >= AVDISCARD_NONKEY)
+        return !info.keyframe;
+    return !info.reference;
+}
+
+// decode one packet into pCodec->frame, return consumed bytes(>=0) if success, else < 0
+long FFDecoder::decodeFrame(const uint8_t *in_data, const int in_size, const FFTimeInfo &in_info, int &got_frame) {
+    FFCodec *pCodec = (FFCodec *)m_video;
+
+    // apply decode policy(maybe reopen codec)
+    returnv_if_fail(applyVideoPolicy() == 0, -1);
 
     // prepare input, flush decoder if input is null & 0.
     pCodec->avpkt.data = (uint8_t *)in_data;
     pCodec->avpkt.size = in_size;
+    pCodec->avpkt.pts = in_info.pts;
+    pCodec->avpkt.dts = in_info.dts;
+    pCodec->avctx->reordered_opaque = in_info.opaque; // returned by frame->reordered_opaque
 
     // decode frame
-    int got_frame = 0;
+    got_frame = 0;
+    av_frame_unref(pCodec->frame);
+    int64_t start_time = av_gettime_relative();
     int consumed_bytes = avcodec_decode_video2(pCodec->avctx, pCodec->frame, &got_frame, &pCodec->avpkt);
+    if (m_vpolicy.quality == FF_DECODE_QUALITY_AUTO) {
+        FFDecodeGovernor::report(av_gettime_relative() - start_time);
+    }
+    if (consumed_bytes >= 0) {
+        if (in_data && in_size > 0 && !isDiscarded(in_data, in_size))
+            m_vdelay++;
+        if (got_frame > 0)
+            m_vdelay--;
+        else if (!in_data)
+            m_vdelay = 0; // drained
+
+        // no more than reordering and frame threads can hold
+        AVCodecContext *avctx = pCodec->avctx;
+        int max_delay = FFMAX(avctx->has_b_frames, 0);
+        if (avctx->active_thread_type & FF_THREAD_FRAME)
+            max_delay += FFMAX(avctx->thread_count - 1, 0);
+        m_vdelay = FFMAX(0, FFMIN(m_vdelay, max_delay));
+    }
+    return consumed_bytes;
+}
+
+// return consumed bytes(>0) if success, else < 0
+long FFDecoder::decodeVideo(const uint8_t *in_data, int in_size, uint8_t *out_data, int &out_size, 
+        const FFVideoFormat &out_fmt) {
+    returnv_if_fail(m_video, -1);
+    returnv_if_fail(out_data, -1);
+
+    // prepare output(linesize and buffer)
+    int dst_linesize[4] = { 0 };
+    uint8_t *dst_data[4] = { 0 };
+    long lret = prepareVideo(out_fmt, out_data, out_size, dst_data, dst_linesize);
+    returnv_if_fail(lret > 0, -1);
+    out_size = (int)lret; // actual output size if success
+
+    // decode frame
+    int got_frame = 0;
+    long consumed_bytes = decodeFrame(in_data, in_size, FFTimeInfo(), got_frame);
     if (consumed_bytes < 0 || got_frame <= 0) {
         LOGE("decode failure or no output, return="<<consumed_bytes);
         return consumed_bytes;
     }
 
-    if (!sws_isSupportedInput(pCodec->avctx->pix_fmt)) {
-        LOGE("(sws) unsupported decoded pix_fmt="<<pCodec->avctx->pix_fmt);
-        return -1;
+    lret = scaleVideo(out_fmt, dst_data, dst_linesize, SWS_FAST_BILINEAR);
+    returnv_if_fail(lret == 0, -1);
+
+    return consumed_bytes;
+}
+
+// decode once for many consumers, and out_frame is empty if no picture.
+// return consumed bytes(>=0) if success, else < 0
+long FFDecoder::decodeVideo(const uint8_t *in_data, const int in_size, FFFrame &out_frame) {
+    return decodeVideo(in_data, in_size, FFTimeInfo(), out_frame);
+}
+
+// out_frame.getTimeInfo() is the in_info of its packet.
+// return consumed bytes(>=0) if success, else < 0
+long FFDecoder::decodeVideo(const uint8_t *in_data, const int in_size, const FFTimeInfo &in_info, FFFrame &out_frame) {
+    returnv_if_fail(m_video, -1);
+    out_frame.reset();
+
+    int got_frame = 0;
+    long consumed_bytes = decodeFrame(in_data, in_size, in_info, got_frame);
+    if (consumed_bytes < 0 || got_frame <= 0) {
+        return consumed_bytes;
     }
 
-    // prepare sws convert
-    FFPixelFormat avctx_pix_fmt = GetFFPixelFormat(pCodec->avctx->pix_fmt);
-    if (m_vfmt.width != pCodec->avctx->width ||
-        m_vfmt.height != pCodec->avctx->height ||
-        m_vfmt.pix_fmt != avctx_pix_fmt) 
-    {
-        m_vfmt.width = pCodec->avctx->width;
-        m_vfmt.height = pCodec->avctx->height;
-        m_vfmt.pix_fmt = avctx_pix_fmt;
+    FFCodec *pCodec = (FFCodec *)m_video;
+    returnv_if_fail(out_frame.attach(pCodec->frame) == 0, -1);
+    return consumed_bytes;
+}
+
+// return consumed bytes(>=0) if success, else < 0
+long FFDecoder::decodeVideo(const uint8_t *in_data, const int in_size, const FFTimeInfo &in_info,
+        uint8_t *out_data, int &out_size, const FFVideoFormat &out_fmt, FFTimeInfo &out_info) {
+    returnv_if_fail(m_video, -1);
+    returnv_if_fail(out_data, -1);
+    out_info.reset();
+
+    int dst_linesize[4] = { 0 };
+    uint8_t *dst_data[4] = { 0 };
+    long lret = prepareVideo(out_fmt, out_data, out_size, dst_data, dst_linesize);
+    returnv_if_fail(lret > 0, -1);
+    int image_size = (int)lret;
+    out_size = 0;
+
+    int got_frame = 0;
+    long consumed_bytes = decodeFrame(in_data, in_size, in_info, got_frame);
+    if (consumed_bytes < 0 || got_frame <= 0) {
+        return consumed_bytes;
+    }
+
+    lret = scaleVideo(out_fmt, dst_data, dst_linesize, SWS_FAST_BILINEAR);
+    returnv_if_fail(lret == 0, -1);
+    out_size = image_size;
+    GetFrameTimeInfo(((FFCodec *)m_video)->frame, out_info);
+
+    return consumed_bytes;
+}
+
+int FFDecoder::getVideoDelay() const {
+    return m_vdelay;
+}
 
-        // reset sws context when format changes
-        sws_freeContext(pCodec->swsctx);
-        pCodec->swsctx = sws_getContext(pCodec->avctx->width, pCodec->avctx->height, pCodec->avctx->pix_fmt,
-                out_width, out_height, out_pix_fmt, SWS_FAST_BILINEAR,
-                NULL, NULL, NULL);
+// only key frames are decoded, and lowres is selected by out_fmt size where codec allows.
+// return consumed bytes(>=0) if success, else < 0, and out_size is 0 if no thumbnail.
+long FFDecoder::decodeThumbnail(const uint8_t *in_data, const int in_size, uint8_t *out_data, int &out_size, 
+        const FFVideoFormat &out_fmt) {
+    returnv_if_fail(m_video, -1);
+    returnv_if_fail(out_data, -1);
+
+    int dst_linesize[4] = { 0 };
+    uint8_t *dst_data[4] = { 0 };
+    long lret = prepareVideo(out_fmt, out_data, out_size, dst_data, dst_linesize);
+    returnv_if_fail(lret > 0, -1);
+    int thumb_size = (int)lret;
+    out_size = 0;
+
+    // key-frame only decoding at thumbnail lowres, and caller's policy is kept for decodeVideo
+    FFDecodePolicy policy = m_vpolicy;
+    m_vpolicy.set(FF_DECODE_QUALITY_KEY, m_thumb_lowres);
+
+    int got_frame = 0;
+    long consumed_bytes = decodeFrame(in_data, in_size, FFTimeInfo(), got_frame);
+    m_vpolicy = policy;
+    if (consumed_bytes < 0 || got_frame <= 0) {
+        return consumed_bytes;
     }
-    returnv_if_fail(pCodec->swsctx, -1);
 
-    // sws convert
-    iret = sws_scale(pCodec->swsctx, pCodec->frame->data, pCodec->frame->linesize, 0, pCodec->frame->height,
-            dst_data, dst_linesize);
-    returnv_if_fail(iret == pCodec->avctx->height, -1);
+    FFCodec *pCodec = (FFCodec *)m_video;
+    lret = scaleVideo(out_fmt, dst_data, dst_linesize, SWS_AREA);
+    returnv_if_fail(lret == 0, -1);
+    out_size = thumb_size;
+
+    // select the smallest decoded size not less than thumbnail, used from next key frame
+    int coded_width = pCodec->avctx->width << pCodec->avctx->lowres;
+    int coded_height = pCodec->avctx->height << pCodec->avctx->lowres;
+    int lowres = 0;
+    while (lowres < pCodec->codec->max_lowres &&
+            (coded_width >> (lowres+1)) >= out_fmt.width &&
+            (coded_height >> (lowres+1)) >= out_fmt.height) {
+        lowres++;
+    }
+    if (lowres != m_thumb_lowres) {
+        LOGI("thumbnail lowres changes to "<<lowres<<" for coded size="<<coded_width<<"x"<<coded_height);
+        m_thumb_lowres = lowres;
+    }
 
     return consumed_bytes;
 }
@@ -173,3 +554,29 @@ long FFDecoder::decodeAudio(const uint8_t *in_data, const int in_size, uint8_t *
     return consumed_bytes;
 }
 
+
+// decoded frame is returned without copy, and valid until next decoding.
+// return consumed bytes(>=0) if success, else < 0, and out_frame is NULL if no output.
+long FFDecoder::decodeAudio(const uint8_t *in_data, const int in_size, const AVFrame *&out_frame) {
+    out_frame = NULL;
+    returnv_if_fail(m_audio, -1);
+    returnv_if_fail(in_data, -1);
+
+    FFCodec *pCodec = (FFCodec *)m_audio;
+
+    // prepare input
+    pCodec->avpkt.data = (uint8_t *)in_data;
+    pCodec->avpkt.size = in_size;
+
+    // decode frame
+    int got_frame = 0;
+    int consumed_bytes = avcodec_decode_audio4(pCodec->avctx, pCodec->frame, &got_frame, &pCodec->avpkt);
+    if (consumed_bytes < 0) {
+        LOGE("decode failure, return="<<consumed_bytes);
+        return consumed_bytes;
+    }
+
+    if (got_frame > 0)
+        out_frame = pCodec->frame;
+    return consumed_bytes;
+}
@@ -2,6 +2,22 @@
 #define __FFDECODER_H_
 
 #include "ffparam.h"
+#include "ffplace.h"
+
+class FFFrame;
+
+// global cpu-budget governor for FF_DECODE_QUALITY_AUTO decoders
+class FF_EXPORT FFDecodeGovernor
+{
+public:
+    // budget: cpu time(usec) allowed for decoding per second, 0 to disable
+    static void setBudget(int64_t budget);
+    static int64_t getBudget();
+
+    // account decoding time(usec), or cpu time measured by caller
+    static void report(int64_t usec);
+    static FFDecodeQuality getQuality();
+};
 
 class FF_EXPORT FFDecoder
 {
@@ -9,22 +25,57 @@ public:
     FFDecoder();
     virtual ~FFDecoder();
 
-    long openVideo(FFCodecID codec_id);
+    // cpus and numa node for next openVideo(codec threads and frame buffers)
+    void setPlacement(const FFPlacement &placement);
+    const FFPlacement &getPlacement() const;    // resolved placement of opened video
+
+    long openVideo(FFCodecID codec_id, const uint8_t *extradata = NULL, int extradata_size = 0);
     void closeVideo();
     long decodeVideo(const uint8_t *in_data, const int in_size, uint8_t *out_data, int &out_size, 
         const FFVideoFormat &out_fmt);
+    long decodeVideo(const uint8_t *in_data, const int in_size, FFFrame &out_frame);
 
-    long openAudio(FFCodecID codec_id);
+    // in_info is carried to the frame decoded from this packet(reordered), and out_size is 0
+    // if no picture(delayed by reordering/frame threads, or drained when flushing by NULL input).
+    long decodeVideo(const uint8_t *in_data, const int in_size, const FFTimeInfo &in_info,
+        uint8_t *out_data, int &out_size, const FFVideoFormat &out_fmt, FFTimeInfo &out_info);
+    long decodeVideo(const uint8_t *in_data, const int in_size, const FFTimeInfo &in_info, FFFrame &out_frame);
+    int getVideoDelay() const;  // packets pending for output(skipped ones excluded)
+    long decodeThumbnail(const uint8_t *in_data, const int in_size, uint8_t *out_data, int &out_size, 
+        const FFVideoFormat &out_fmt);
+    long reserveVideo(const FFVideoFormat &fmt, int frames);
+    void setVideoPolicy(const FFDecodePolicy &policy);
+    const FFDecodePolicy &getVideoPolicy() const;
+
+    long openAudio(FFCodecID codec_id, const uint8_t *extradata = NULL, int extradata_size = 0);
     void closeAudio();
     long decodeAudio(const uint8_t *in_data, const int in_size, uint8_t *out_data, int &out_size);
+    long decodeAudio(const uint8_t *in_data, const int in_size, const AVFrame *&out_frame);
+
+    int64_t getMemoryUsage();
 
 protected:
-    long openCodec(ff_codec_t codec, FFCodecID codec_id);
+    long openCodec(ff_codec_t codec, FFCodecID codec_id, const uint8_t *extradata, int extradata_size);
+    long applyVideoPolicy();
+    long prepareVideo(const FFVideoFormat &out_fmt, uint8_t *out_data, int out_size,
+        uint8_t *dst_data[4], int dst_linesize[4]);
+    bool isDiscarded(const uint8_t *in_data, const int in_size);
+    long decodeFrame(const uint8_t *in_data, const int in_size, const FFTimeInfo &in_info, int &got_frame);
+    long scaleVideo(const FFVideoFormat &out_fmt, uint8_t *dst_data[4], int dst_linesize[4], int sws_flags);
 
 private:
     ff_codec_t m_video;
     ff_codec_t m_audio;
     FFVideoFormat m_vfmt;
+    FFVideoFormat m_ofmt;       // validated output format
+    AVPixelFormat m_out_pix_fmt;
+    int m_out_linesize[4];
+    FFDecodePolicy m_vpolicy;
+    FFDecodeQuality m_vquality; // applied quality
+    int m_vdelay;               // packets pending in decoder
+    int m_thumb_lowres;         // lowres selected by decodeThumbnail
+    FFPlacement m_placement;    // requested
+    FFPlacement m_vplace;       // resolved for video session
 };
 
 
@@ -1,16 +1,187 @@
 #include "ffencoder.h"
 #include "fflog.h"
 #include "ffcodec.h"
+#include "ffmetric.h"
+#include "ffscene.h"
+#include "ffalloc.h"
+#include <stdlib.h>
+#include <unistd.h>
+
+// max input frames waiting for reconstructed ones
+#define QUALITY_MAX_FRAMES  64
+
+// x264 stats file, in memory(tmpfs) if possible
+#define STATS_FILE_SHM  "/dev/shm/ffstats_XXXXXX"
+#define STATS_FILE_TMP  "/tmp/ffstats_XXXXXX"
+
+static std::string make_stats_file() {
+    char path[64];
+    strcpy(path, STATS_FILE_SHM);
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        strcpy(path, STATS_FILE_TMP);
+        fd = mkstemp(path);
+    }
+    returnv_if_fail(fd >= 0, "");
+    close(fd);
+    return path;
+}
+
+static void remove_stats_file(const std::string &path) {
+    return_if_fail(!path.empty());
+    unlink(path.c_str());
+    unlink((path + ".temp").c_str());
+    unlink((path + ".mbtree").c_str());
+    unlink((path + ".mbtree.temp").c_str());
+}
+
+static bool read_file(const std::string &path, std::string &data) {
+    data.clear();
+    FILE *fp = fopen(path.c_str(), "rb");
+    returnv_if_fail(fp, false);
+    char buf[4096];
+    size_t size = 0;
+    while ((size = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        data.append(buf, size);
+    }
+    fclose(fp);
+    return true;
+}
+
+static bool write_file(const std::string &path, const std::string &data) {
+    FILE *fp = fopen(path.c_str(), "wb");
+    returnv_if_fail(fp, false);
+    size_t size = fwrite(data.data(), 1, data.size(), fp);
+    fclose(fp);
+    return size == data.size();
+}
+
+// codec defaults for memory estimate(x264 preset fast, libvpx good quality),
+// and whether codec threads keep one frame each in flight.
+typedef struct memory_default_entry_t {
+    enum AVCodecID id;
+    int lookahead;
+    int refs;
+    bool frame_threads;
+}memory_default_entry_t;
+const memory_default_entry_t k_memory_default_entries[] = {
+    { AV_CODEC_ID_H264,  30, 2, true  },
+    { AV_CODEC_ID_VP8,   25, 3, false },
+    { AV_CODEC_ID_MJPEG, 0,  0, false },
+};
+
+static const memory_default_entry_t *find_memory_default(AVCodecID id) {
+    for (size_t i=0; i < sizeof(k_memory_default_entries)/sizeof(k_memory_default_entries[0]); i++) {
+        if (k_memory_default_entries[i].id == id)
+            return &k_memory_default_entries[i];
+    }
+    return NULL;
+}
+
+// codec-internal memory cannot be reported by libavcodec, so estimate it from settings
+static void estimate_memory(AVCodecContext *avctx, int lookahead, int refs, int threads,
+        bool frame_threads, FFMemoryUsage &usage) {
+    // padded frame as encoders keep it(e.g. x264 has 32 pixels border)
+    int frame_size = av_image_get_buffer_size(avctx->pix_fmt,
+            FFALIGN(avctx->width, 16) + 64, FFALIGN(avctx->height, 16) + 64, 64);
+    if (frame_size < 0)
+        frame_size = 0;
+
+    usage.lookahead = (int64_t)frame_size * (lookahead + FFMAX(avctx->max_b_frames, 0));
+    usage.refs = (int64_t)frame_size * (refs + 1); // and the reconstructed one
+    usage.threads = frame_threads ? (int64_t)frame_size * FFMAX(threads - 1, 0) : 0;
+}
+
+// split annex-b h264 frame at the end of each VCL NAL, return count of slice ends
+static int split_h264_slices(const uint8_t *data, int size, std::vector<int> &ends) {
+    ends.clear();
+    int pos = find_start_code(data, size, 0);
+    while (pos < size) {
+        int start = skip_start_code(data, size, pos);
+        int next = find_start_code(data, size, start);
+        if (start < size) {
+            int nal_type = data[start] & 0x1f;
+            if (nal_type >= 1 && nal_type <= 5)
+                ends.push_back(next);
+        }
+        pos = next;
+    }
+    if (ends.empty() || ends.back() != size) {
+        if (ends.empty())
+            ends.push_back(size);
+        else
+            ends.back() = size; // trailing non-VCL NALs go with the last slice
+    }
+    return (int)ends.size();
+}
+
+// split vp8 frame into first partition(with frame header and partition sizes) and token partitions,
+// return count of slice ends(RFC 6386 9.1 and 9.5)
+static int split_vp8_partitions(const uint8_t *data, int size, int partitions, std::vector<int> &ends) {
+    ends.clear();
+    if (size >= 3 && partitions > 1) {
+        uint32_t tag = data[0] | (data[1] << 8) | (data[2] << 16);
+        bool keyframe = !(tag & 1);
+        int first_size = (tag >> 5) & 0x7ffff;
+        int pos = (keyframe ? 10 : 3) + first_size + 3 * (partitions - 1);
+        if (pos <= size) {
+            const uint8_t *sizes = data + pos - 3 * (partitions - 1);
+            ends.push_back(pos);
+            for (int i = 0; i < partitions - 1; i++) {
+                pos += sizes[3*i] | (sizes[3*i+1] << 8) | (sizes[3*i+2] << 16);
+                if (pos > size)
+                    break;
+                ends.push_back(pos);
+            }
+        }
+        if (pos > size)
+            ends.clear();
+    }
+    if (ends.empty() || ends.back() != size)
+        ends.push_back(size); // last partition or whole frame
+    return (int)ends.size();
+}
+
+struct FFEncoder::QualityFrame {
+    int64_t pts;
+    int width;
+    int height;
+    std::vector<uint8_t> luma;
+};
 
 FFEncoder::FFEncoder() {
     m_video = NULL;
     m_audio = NULL;
     m_vfmt.reset();
+    m_in_pix_fmt = AV_PIX_FMT_NONE;
+    m_in_convert = false;
+    m_in_converter = NULL;
+    m_memory_cap = 0;
+    m_memory_floor = false;
+    m_vshrink = false;
+    m_vlookahead = 0;
+    m_vthreads = 0;
+    m_vrefs = 0;
+    m_slice_callback = NULL;
+    m_slice_opaque = NULL;
+    m_vp8_partitions = 1;
+    m_vpts = 0;
+    m_vdts_index = 0;
+    m_quality_callback = NULL;
+    m_quality_opaque = NULL;
+    m_quality_interval = 1;
+    m_quality_step = 1;
+    m_recon = NULL;
+    m_scene = NULL;
+    m_gop_size = 0;
+    m_max_gop_size = 0;
+    m_gop_frames = -1;
 }
 
 FFEncoder::~FFEncoder() {
     closeVideo();
     closeAudio();
+    remove_stats_file(m_stats_file);
 }
 
 long FFEncoder::openContext(ff_codec_t codec, FFCodecID codec_id) {
@@ -39,6 +210,15 @@ long FFEncoder::openCodec(ff_codec_t codec, const FFVideoFormat &fmt) {
     pCodec->avctx->time_base = (AVRational){1,fmt.fps};
     pCodec->avctx->gop_size = fmt.data.gop_size;
     pCodec->avctx->max_b_frames = fmt.data.max_b_frames;
+    if (fmt.data.global_header) {
+        pCodec->avctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+    if (fmt.data.closed_gop) {
+        pCodec->avctx->flags |= AV_CODEC_FLAG_CLOSED_GOP;
+    }
+    if (fmt.data.thread_count > 0) {
+        pCodec->avctx->thread_count = fmt.data.thread_count;
+    }
 
     AVPixelFormat pix_fmt = GetAVPixelFormat(fmt.pix_fmt);
     if (!check_pix_fmt(pCodec->codec, pix_fmt)) {
@@ -53,8 +233,17 @@ long FFEncoder::openCodec(ff_codec_t codec, const FFVideoFormat &fmt) {
     if (pCodec->avctx->codec_id == AV_CODEC_ID_H264) {
         av_opt_set(pCodec->avctx->priv_data, "preset", "fast", 0);
     }
+    returnv_if_fail(setRateControl(codec, fmt) == 0, -1);
+    returnv_if_fail(setMemoryBudget(codec, fmt) == 0, -1);
+    returnv_if_fail(setSlices(codec, fmt) == 0, -1);
+    returnv_if_fail(setSceneDetect(codec, fmt) == 0, -1);
 
-    int iret = avcodec_open2(pCodec->avctx, pCodec->codec, NULL);
+    int iret = -1;
+    {
+        // codec threads(and x264 lookahead) inherit affinity of opening thread
+        FFPlaceGuard guard(m_vplace);
+        iret = avcodec_open2(pCodec->avctx, pCodec->codec, NULL);
+    }
     returnv_if_fail(iret == 0, -1);
 
     av_init_packet(&pCodec->avpkt);
@@ -62,6 +251,356 @@ long FFEncoder::openCodec(ff_codec_t codec, const FFVideoFormat &fmt) {
     pCodec->avpkt.size = 0;
     return 0;
 }
+
+// set rate control before opening, return 0 if success, else < 0
+long FFEncoder::setRateControl(ff_codec_t codec, const FFVideoFormat &fmt) {
+    FFCodec *pCodec = (FFCodec *)codec;
+    AVCodecContext *avctx = pCodec->avctx;
+    bool is_h264 = (avctx->codec_id == AV_CODEC_ID_H264);
+
+    if (fmt.data.lookahead > 0) {
+        avctx->rc_lookahead = fmt.data.lookahead;
+        if (avctx->codec_id == AV_CODEC_ID_VP8)
+            av_opt_set_int(avctx->priv_data, "lag-in-frames", fmt.data.lookahead, 0);
+    }
+
+    switch(fmt.data.rc_mode) {
+        case FF_RC_ABR:
+            break;
+        case FF_RC_CRF:
+            // libvpx keeps bitrate as the cap of constrained quality
+            av_opt_set_int(avctx->priv_data, "crf", fmt.data.crf, 0);
+            if (is_h264)
+                avctx->bit_rate = 0;
+            break;
+        case FF_RC_TWOPASS:
+            if (fmt.data.pass == 1) {
+                avctx->flags |= AV_CODEC_FLAG_PASS1;
+                m_pass_stats.reset();
+                if (is_h264) {
+                    m_stats_file = make_stats_file();
+                    returnv_if_fail(!m_stats_file.empty(), -1);
+                    av_opt_set(avctx->priv_data, "stats", m_stats_file.c_str(), 0);
+                    av_opt_set_int(avctx->priv_data, "fastfirstpass", fmt.data.fast_first_pass ? 1 : 0, 0);
+                }else if (fmt.data.fast_first_pass) {
+                    av_opt_set_int(avctx->priv_data, "cpu-used", 8, 0);
+                }
+            }else if (fmt.data.pass == 2) {
+                returnv_if_fail(!m_pass_stats.stats.empty(), -1);
+                avctx->flags |= AV_CODEC_FLAG_PASS2;
+                if (is_h264) {
+                    m_stats_file = make_stats_file();
+                    returnv_if_fail(!m_stats_file.empty(), -1);
+                    returnv_if_fail(write_file(m_stats_file, m_pass_stats.stats), -1);
+                    if (!m_pass_stats.mbtree.empty())
+                        returnv_if_fail(write_file(m_stats_file + ".mbtree", m_pass_stats.mbtree), -1);
+                    av_opt_set(avctx->priv_data, "stats", m_stats_file.c_str(), 0);
+                }else {
+                    avctx->stats_in = (char *)m_pass_stats.stats.c_str(); // owned by m_pass_stats
+                }
+            }else {
+                LOGE("invalid pass="<<fmt.data.pass);
+                return -1;
+            }
+            break;
+        default:
+            LOGE("unsupported rc_mode="<<fmt.data.rc_mode);
+            return -1;
+    }
+    return 0;
+}
+
+// estimate memory and shrink lookahead, threads and refs in turn to fit the cap,
+// set before opening, return 0 if success, else < 0
+long FFEncoder::setMemoryBudget(ff_codec_t codec, const FFVideoFormat &fmt) {
+    FFCodec *pCodec = (FFCodec *)codec;
+    AVCodecContext *avctx = pCodec->avctx;
+
+    const memory_default_entry_t *entry = find_memory_default(avctx->codec_id);
+    int lookahead = fmt.data.lookahead > 0 ? fmt.data.lookahead : (entry ? entry->lookahead : 0);
+    int refs = fmt.data.refs > 0 ? fmt.data.refs : (entry ? entry->refs : 0);
+    int threads = fmt.data.thread_count > 0 ? fmt.data.thread_count : av_cpu_count();
+    bool frame_threads = entry ? entry->frame_threads : false;
+    bool set_refs = (avctx->codec_id == AV_CODEC_ID_H264); // vp8 has fixed refs
+    if (set_refs && fmt.data.refs > 0) {
+        avctx->refs = refs;
+    }
+    bool shrunk = m_vshrink;
+    if (m_vshrink) {
+        // reopened by shrinkMemory with its settings
+        lookahead = m_vlookahead;
+        threads = m_vthreads;
+        refs = m_vrefs;
+    }
+
+    m_vusage.reset();
+    estimate_memory(avctx, lookahead, refs, threads, frame_threads, m_vusage);
+    while (fmt.data.memory_cap > 0 && m_vusage.total() > fmt.data.memory_cap) {
+        if (lookahead > 0) {
+            lookahead /= 2;
+        }else if (threads > 1) {
+            threads /= 2;
+        }else if (set_refs && refs > 1) {
+            refs--;
+        }else {
+            break;
+        }
+        shrunk = true;
+        estimate_memory(avctx, lookahead, refs, threads, frame_threads, m_vusage);
+    }
+    m_vlookahead = lookahead;
+    m_vthreads = threads;
+    m_vrefs = refs;
+    if (!shrunk)
+        return 0;
+
+    avctx->rc_lookahead = lookahead;
+    if (avctx->codec_id == AV_CODEC_ID_VP8)
+        av_opt_set_int(avctx->priv_data, "lag-in-frames", lookahead, 0);
+    avctx->thread_count = threads;
+    if (set_refs)
+        avctx->refs = refs;
+
+    LOGW("shrink for memory_cap="<<fmt.data.memory_cap<<", lookahead="<<lookahead<<", threads="<<threads
+            <<", refs="<<refs<<", estimated="<<m_vusage.total());
+    return 0;
+}
+
+// set slices before opening, return 0 if success, else < 0
+long FFEncoder::setSlices(ff_codec_t codec, const FFVideoFormat &fmt) {
+    FFCodec *pCodec = (FFCodec *)codec;
+    AVCodecContext *avctx = pCodec->avctx;
+
+    m_vp8_partitions = 1;
+    bool low_delay = (fmt.data.slices > 1 || fmt.data.slice_max_size > 0);
+    if (fmt.data.slices > 1) {
+        avctx->slices = fmt.data.slices;
+        if (avctx->codec_id == AV_CODEC_ID_H264) {
+            // sliced threads encode slices of one frame in parallel
+            avctx->thread_type = FF_THREAD_SLICE;
+        }else if (avctx->codec_id == AV_CODEC_ID_VP8) {
+            // libvpx uses log2 of slices as token partitions(max 8)
+            m_vp8_partitions = 1 << FFMIN(av_log2(fmt.data.slices), 3);
+        }
+    }
+    if (fmt.data.slice_max_size > 0 && avctx->codec_id == AV_CODEC_ID_H264) {
+        av_opt_set_int(avctx->priv_data, "slice-max-size", fmt.data.slice_max_size, 0);
+    }
+
+    // no frame delay with slices: each input frame is output by its own encodeVideo
+    if (low_delay) {
+        avctx->max_b_frames = 0;
+        avctx->rc_lookahead = 0;
+        m_vusage.lookahead = 0;
+        m_vlookahead = 0;
+        if (avctx->codec_id == AV_CODEC_ID_H264) {
+            av_opt_set(avctx->priv_data, "tune", "zerolatency", 0); // no lookahead/b-frames/sync-lookahead
+        }else if (avctx->codec_id == AV_CODEC_ID_VP8) {
+            av_opt_set_int(avctx->priv_data, "lag-in-frames", 0, 0);
+        }
+    }
+    return 0;
+}
+
+// keyframes are placed by scene detector within the stretched gop, set before opening
+long FFEncoder::setSceneDetect(ff_codec_t codec, const FFVideoFormat &fmt) {
+    FFCodec *pCodec = (FFCodec *)codec;
+    AVCodecContext *avctx = pCodec->avctx;
+
+    safe_delete(m_scene);
+    m_gop_frames = -1;
+    if (!fmt.data.scene_detect)
+        return 0;
+
+    m_scene = new FFSceneDetector();
+    m_gop_size = fmt.data.gop_size;
+    m_max_gop_size = fmt.data.max_gop_size > 0 ? fmt.data.max_gop_size : 2 * m_gop_size;
+    if (m_gop_size > 0) {
+        avctx->gop_size = FFMAX(m_max_gop_size, m_gop_size);
+    }
+    // keyframes are only decided by scene detector, not also by encoder's scenecut
+    avctx->scenechange_threshold = 0;
+    if (avctx->codec_id == AV_CODEC_ID_H264) {
+        av_opt_set_int(avctx->priv_data, "forced-idr", 1, 0); // forced I as IDR
+    }
+    return 0;
+}
+
+// force keyframe at scene cut(not too close to last one), or at gop_size unless content is still
+void FFEncoder::placeKeyframe(AVFrame *frame) {
+    FFSceneInfo info;
+    if (m_scene->analyze(frame->data[0], frame->linesize[0], frame->width, frame->height, info) != 0) {
+        frame->pict_type = AV_PICTURE_TYPE_NONE;
+        return;
+    }
+
+    int min_gop_size = FFMAX(m_gop_size / 10, 1);
+    bool keyframe = (m_gop_frames < 0);
+    if (info.scene_cut && m_gop_frames >= min_gop_size) {
+        keyframe = true;
+    }else if (m_gop_size > 0 && m_gop_frames >= m_gop_size && (!info.still || m_gop_frames >= m_max_gop_size)) {
+        keyframe = true;
+    }
+
+    info.keyframe = keyframe;
+    frame->pict_type = keyframe ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+    m_gop_frames = keyframe ? 1 : m_gop_frames + 1;
+    m_scene_info = info;
+}
+
+const FFSceneInfo &FFEncoder::getSceneInfo() const {
+    return m_scene_info;
+}
+
+void FFEncoder::setSliceCallback(FFSliceCallback callback, void *opaque) {
+    m_slice_callback = callback;
+    m_slice_opaque = opaque;
+}
+
+void FFEncoder::deliverSlices(const uint8_t *data, int size) {
+    return_if_fail(m_slice_callback && data && size > 0);
+
+    std::vector<int> ends;
+    AVCodecID codec_id = ((FFCodec *)m_video)->avctx->codec_id;
+    if (codec_id == AV_CODEC_ID_H264) {
+        split_h264_slices(data, size, ends);
+    }else if (codec_id == AV_CODEC_ID_VP8) {
+        split_vp8_partitions(data, size, m_vp8_partitions, ends);
+    }else {
+        ends.push_back(size);
+    }
+
+    int start = 0;
+    for (size_t i = 0; i < ends.size(); i++) {
+        m_slice_callback(m_slice_opaque, data + start, ends[i] - start, (int)i, i + 1 == ends.size());
+        start = ends[i];
+    }
+}
+
+// open a decoder of output for reconstructed frames, return 0 if success, else < 0
+long FFEncoder::setQualityCallback(FFQualityCallback callback, void *opaque, int frame_interval, int pixel_step) {
+    closeQuality();
+    if (!callback)
+        return 0;
+    returnv_if_fail(m_video, -1);
+
+    FFCodec *pCodec = (FFCodec *)m_video;
+    FFCodec *pRecon = new FFCodec(FF_MEDIA_VIDEO);
+    m_recon = (ff_codec_t)pRecon;
+
+    long lret = -1;
+    pRecon->codec = avcodec_find_decoder(pCodec->avctx->codec_id);
+    if (pRecon->codec)
+        pRecon->avctx = avcodec_alloc_context3(pRecon->codec);
+    if (pRecon->avctx) {
+        pRecon->avctx->thread_count = 1; // no frame delay of threads
+        int extradata_size = pCodec->avctx->extradata_size;
+        if (extradata_size > 0) {
+            pRecon->avctx->extradata = (uint8_t *)av_mallocz(extradata_size + AV_INPUT_BUFFER_PADDING_SIZE);
+            if (pRecon->avctx->extradata) {
+                memcpy(pRecon->avctx->extradata, pCodec->avctx->extradata, extradata_size);
+                pRecon->avctx->extradata_size = extradata_size;
+            }
+        }
+        if (avcodec_open2(pRecon->avctx, pRecon->codec, NULL) == 0)
+            lret = 0;
+    }
+    if (lret == 0) {
+        pRecon->frame = av_frame_alloc();
+        if (!pRecon->frame)
+            lret = -1;
+    }
+    if (lret != 0) {
+        LOGE("fail to open decoder for quality, codec_id="<<pCodec->avctx->codec_id);
+        safe_delete_codec(m_recon);
+        return -1;
+    }
+
+    m_quality_callback = callback;
+    m_quality_opaque = opaque;
+    m_quality_interval = FFMAX(frame_interval, 1);
+    m_quality_step = FFMAX(pixel_step, 1);
+    return 0;
+}
+
+void FFEncoder::closeQuality() {
+    safe_delete_codec(m_recon);
+    while (!m_quality_frames.empty()) {
+        delete m_quality_frames.front();
+        m_quality_frames.pop_front();
+    }
+    for (size_t i = 0; i < m_quality_pool.size(); i++) {
+        delete m_quality_pool[i];
+    }
+    m_quality_pool.clear();
+    m_quality_callback = NULL;
+    m_quality_opaque = NULL;
+}
+
+// keep luma of input frame until its reconstructed one
+void FFEncoder::keepQualityFrame(const AVFrame *frame) {
+    QualityFrame *qframe = NULL;
+    if (m_quality_frames.size() >= QUALITY_MAX_FRAMES) {
+        qframe = m_quality_frames.front();
+        m_quality_frames.pop_front();
+    }else if (!m_quality_pool.empty()) {
+        qframe = m_quality_pool.back();
+        m_quality_pool.pop_back();
+    }else {
+        qframe = new QualityFrame;
+    }
+
+    qframe->pts = frame->pts;
+    qframe->width = frame->width;
+    qframe->height = frame->height;
+    qframe->luma.resize((size_t)frame->width * frame->height);
+    av_image_copy_plane(&qframe->luma[0], frame->width, frame->data[0], frame->linesize[0],
+            frame->width, frame->height);
+    m_quality_frames.push_back(qframe);
+}
+
+// decode output and compare with kept input(NULL data to drain),
+// return 1 if one frame is reconstructed, else 0
+long FFEncoder::measureQuality(const uint8_t *data, int size, int64_t pts) {
+    returnv_if_fail(m_recon, 0);
+    FFCodec *pRecon = (FFCodec *)m_recon;
+
+    AVPacket pkt;
+    av_init_packet(&pkt);
+    pkt.data = (uint8_t *)data;
+    pkt.size = size;
+    pkt.pts = pts;
+
+    int got_frame = 0;
+    int iret = avcodec_decode_video2(pRecon->avctx, pRecon->frame, &got_frame, &pkt);
+    if (iret < 0 || !got_frame)
+        return 0;
+
+    // reconstructed frames are in display order, and inputs not sampled are skipped
+    AVFrame *frame = pRecon->frame;
+    int64_t frame_pts = av_frame_get_best_effort_timestamp(frame);
+    while (!m_quality_frames.empty() && m_quality_frames.front()->pts < frame_pts) {
+        m_quality_pool.push_back(m_quality_frames.front());
+        m_quality_frames.pop_front();
+    }
+    if (m_quality_frames.empty() || m_quality_frames.front()->pts != frame_pts)
+        return 1;
+
+    QualityFrame *qframe = m_quality_frames.front();
+    m_quality_frames.pop_front();
+    if (qframe->width == frame->width && qframe->height == frame->height) {
+        FFQualityStats stats;
+        stats.pts = frame_pts;
+        stats.psnr = ComputePlanePSNR(&qframe->luma[0], qframe->width, frame->data[0], frame->linesize[0],
+                frame->width, frame->height, m_quality_step);
+        stats.ssim = ComputePlaneSSIM(&qframe->luma[0], qframe->width, frame->data[0], frame->linesize[0],
+                frame->width, frame->height, m_quality_step);
+        m_quality_callback(m_quality_opaque, stats);
+    }
+    m_quality_pool.push_back(qframe);
+    return 1;
+}
+
 long FFEncoder::openCodec(ff_codec_t codec, const FFAudioFormat &fmt) {
     FFCodec *pCodec = (FFCodec *)codec;
     returnv_if_fail(pCodec, -1);
@@ -100,11 +639,35 @@ long FFEncoder::openCodec(ff_codec_t codec, const FFAudioFormat &fmt) {
     return 0;
 }
 
+// extradata is owned by encoder, return 0 if success, else < 0
+long FFEncoder::getExtradata(ff_codec_t codec, const uint8_t *&data, int &size) {
+    FFCodec *pCodec = (FFCodec *)codec;
+    returnv_if_fail(pCodec && pCodec->avctx, -1);
+
+    data = pCodec->avctx->extradata;
+    size = pCodec->avctx->extradata_size;
+    return 0;
+}
+
 long FFEncoder::openVideo(FFCodecID codec_id, const FFVideoFormat &format) {
     returnv_if_fail(!m_video, 1); // opened
     m_video = (ff_codec_t)new FFCodec(FF_MEDIA_VIDEO);
     returnv_if_fail(m_video, -1);
     m_vfmt.reset();
+    m_vopen_fmt = format;
+    m_memory_cap = format.data.memory_cap;
+    m_memory_floor = false;
+
+    m_vplace = m_placement;
+    if (m_vplace.node != FF_NODE_NONE || !m_vplace.cpus.empty()) {
+        if (FFPlacer::acquire(m_vplace) == 0) {
+            if (m_vplace.node >= 0) // no node allocator for cpus only
+                ((FFCodec *)m_video)->arena.setAllocator(FFNodeAllocator::instance(m_vplace.node));
+        }else {
+            LOGW("fail to place on node="<<m_placement.node<<", and run unplaced");
+            m_vplace.reset();
+        }
+    }
 
     long lret = openContext(m_video, codec_id);
     if (lret == 0) {
@@ -113,11 +676,63 @@ long FFEncoder::openVideo(FFCodecID codec_id, const FFVideoFormat &format) {
             return 0;
     }
     safe_delete_codec(m_video);
+    if (m_vplace.node >= 0)
+        FFPlacer::release(m_vplace);
+    m_vplace.reset();
     return lret;
 }
+void FFEncoder::setPlacement(const FFPlacement &placement) {
+    m_placement = placement;
+}
+
+const FFPlacement &FFEncoder::getPlacement() const {
+    return m_vplace;
+}
+
 void FFEncoder::closeVideo() {
+    // collect first pass stats(x264 writes its file when closing)
+    bool first_pass = false;
+    FFCodec *pCodec = (FFCodec *)m_video;
+    if (pCodec && pCodec->avctx) {
+        first_pass = (pCodec->avctx->flags & AV_CODEC_FLAG_PASS1) != 0;
+        if (first_pass && pCodec->avctx->stats_out)
+            m_pass_stats.stats = pCodec->avctx->stats_out;
+        pCodec->avctx->stats_in = NULL;
+    }
+    closeQuality();
+    safe_delete(m_scene);
+    m_scene_info.reset();
     safe_delete_codec(m_video);
     m_vfmt.reset();
+    m_vusage.reset();
+    m_vpts = 0;
+    m_vtimes.clear();
+    m_vdts.clear();
+    m_vdts_index = 0;
+    m_vpending.clear();
+    m_vopen_fmt.reset();
+    m_memory_cap = 0;
+    m_memory_floor = false;
+    if (m_vplace.node >= 0)
+        FFPlacer::release(m_vplace);
+    m_vplace.reset();
+
+    if (!m_stats_file.empty()) {
+        if (first_pass) {
+            read_file(m_stats_file, m_pass_stats.stats);
+            read_file(m_stats_file + ".mbtree", m_pass_stats.mbtree);
+        }
+        remove_stats_file(m_stats_file);
+        m_stats_file.clear();
+    }
+}
+
+const FFPassStats &FFEncoder::getPassStats() const {
+    return m_pass_stats;
+}
+
+void FFEncoder::setPassStats(const FFPassStats &stats) {
+    m_pass_stats = stats;
 }
 
 long FFEncoder::openAudio(FFCodecID codec_id, const FFAudioFormat &format) {
@@ -138,11 +753,244 @@ void FFEncoder::closeAudio() {
     safe_delete_codec(m_audio);
 }
 
+// bytes held by video and audio sessions
+int64_t FFEncoder::getMemoryUsage() {
+    FFMemoryUsage usage;
+    getMemoryUsage(usage);
+    return usage.total();
+}
+
+// per component, where frames are measured and others are estimated
+void FFEncoder::getMemoryUsage(FFMemoryUsage &usage) {
+    usage = m_vusage;
+    usage.frames = 0;
+    if (m_video)
+        usage.frames += ((FFCodec *)m_video)->arena.getUsedBytes();
+    if (m_audio)
+        usage.frames += ((FFCodec *)m_audio)->arena.getUsedBytes();
+}
+
+long FFEncoder::getVideoExtradata(const uint8_t *&data, int &size) {
+    return getExtradata(m_video, data, size);
+}
+
+long FFEncoder::getAudioExtradata(const uint8_t *&data, int &size) {
+    return getExtradata(m_audio, data, size);
+}
+
+// validate input format and prepare conversion, return 0 if success, else < 0
+long FFEncoder::prepareInput(const FFVideoFormat &in_fmt) {
+    FFCodec *pCodec = (FFCodec *)m_video;
+
+    AVPixelFormat in_pix_fmt = GetAVPixelFormat(in_fmt.pix_fmt);
+    if (in_pix_fmt == AV_PIX_FMT_NONE) {
+        LOGE("unsupported format ff_pix_fmt="<<in_fmt.pix_fmt);
+        return -1;
+    }
+    m_in_pix_fmt = in_pix_fmt;
+    m_in_convert = (in_pix_fmt != pCodec->avctx->pix_fmt || 
+        in_fmt.width != pCodec->avctx->width || 
+        in_fmt.height != pCodec->avctx->height);
+    m_in_converter = NULL;
+    m_vusage.scaler = 0;
+    if (!m_in_convert)
+        return 0;
+
+    // specialized converter for same size, else sws
+    if (in_fmt.width == pCodec->avctx->width && in_fmt.height == pCodec->avctx->height) {
+        m_in_converter = GetPixelConverter(in_fmt.pix_fmt, GetFFPixelFormat(pCodec->avctx->pix_fmt));
+        if (m_in_converter)
+            return 0;
+    }
+
+    // convert pix_fmt
+    if (!sws_isSupportedInput(in_pix_fmt) || !sws_isSupportedOutput(pCodec->avctx->pix_fmt)) {
+        LOGE("(sws) unsupported from av_pix_fmt="<<in_pix_fmt<<" to av_pix_fmt="<<pCodec->avctx->pix_fmt);
+        return -1;
+    }
+
+    sws_freeContext(pCodec->swsctx);
+    pCodec->swsctx = sws_getContext(in_fmt.width, in_fmt.height, in_pix_fmt,
+        pCodec->avctx->width, pCodec->avctx->height, pCodec->avctx->pix_fmt, SWS_FAST_BILINEAR,
+        NULL, NULL, NULL);
+    returnv_if_fail(pCodec->swsctx, -1);
+
+    // filter coefficients of both directions, and a ring of 16-bit lines per plane
+    m_vusage.scaler = (int64_t)(in_fmt.width + pCodec->avctx->width + in_fmt.height + pCodec->avctx->height) * 2 * 4 +
+        (int64_t)FFALIGN(FFMAX(in_fmt.width, pCodec->avctx->width), 16) * 2 * 4 * 4;
+    return 0;
+}
+
+// keep info of input frame until its packet is output
+void FFEncoder::pushTimeInfo(int64_t index, const FFTimeInfo &info) {
+    FFTimeInfo &time = m_vtimes[index];
+    time = info;
+    if (time.pts == AV_NOPTS_VALUE)
+        time.pts = index;
+    if (m_vdts.empty())
+        m_vdts_index = index;
+    m_vdts.push_back(time.pts);
+}
+
+// map packet's pts/dts(input index) to input info
+void FFEncoder::popTimeInfo(const AVPacket &pkt, FFTimeInfo &info) {
+    info.reset();
+    std::map<int64_t, FFTimeInfo>::iterator it = m_vtimes.find(pkt.pts);
+    if (it != m_vtimes.end()) {
+        info = it->second;
+        m_vtimes.erase(it);
+    }
+    info.keyframe = (pkt.flags & AV_PKT_FLAG_KEY) != 0;
+
+    // dts index increases by packet, and is negative for the first ones with b-frames
+    int64_t index = pkt.dts;
+    if (index == AV_NOPTS_VALUE) {
+        info.dts = info.pts;
+        return;
+    }
+    while (m_vdts.size() > 1 && m_vdts_index < index) {
+        m_vdts.pop_front();
+        m_vdts_index++;
+    }
+    if (m_vdts.empty()) {
+        info.dts = info.pts;
+    }else if (index >= m_vdts_index) {
+        info.dts = m_vdts.front();
+    }else {
+        // before the first input, extrapolated by its frame duration
+        int64_t step = m_vdts.size() > 1 ? m_vdts[1] - m_vdts[0] : 1;
+        info.dts = m_vdts.front() - (m_vdts_index - index) * step;
+    }
+}
+
+int FFEncoder::getVideoDelay() const {
+    return (int)(m_vtimes.size() + m_vpending.size());
+}
+
+// keep packet drained before reopening, to be output by next calls
+void FFEncoder::pushPacket(const AVPacket &pkt) {
+    m_vpending.push_back(PendingPacket());
+    PendingPacket &packet = m_vpending.back();
+    packet.data.assign(pkt.data, pkt.data + pkt.size);
+    packet.pts = pkt.pts;
+    popTimeInfo(pkt, packet.info);
+}
+
+// output the oldest pending packet, return 0 if success, else < 0
+long FFEncoder::popPacket(uint8_t *out_data, int &out_size, FFTimeInfo &out_info) {
+    PendingPacket &packet = m_vpending.front();
+    int size = (int)packet.data.size();
+    returnv_if_fail(size <= out_size, -1);
+    memcpy(out_data, &packet.data[0], size);
+    out_size = size;
+    out_info = packet.info;
+    int64_t pts = packet.pts;
+    m_vpending.pop_front();
+
+    deliverSlices(out_data, out_size);
+    measureQuality(out_data, out_size, pts);
+    return 0;
+}
+
+// reopen video codec with smaller settings when usage is over memory_cap, shrinking lookahead,
+// threads and refs in turn as setMemoryBudget. delayed packets are drained first and output by
+// next calls. return 0 if success(or nothing to shrink), else < 0
+long FFEncoder::shrinkMemory() {
+    FFCodec *pCodec = (FFCodec *)m_video;
+    AVCodecContext *avctx = pCodec->avctx;
+    int64_t over = getMemoryUsage() - m_memory_cap;
+    if (m_vopen_fmt.data.global_header || m_vopen_fmt.data.rc_mode == FF_RC_TWOPASS) {
+        // extradata or pass stats would not match the reopened codec
+        LOGW("over memory_cap="<<m_memory_cap<<" by "<<over<<", and not reopened for global header or two pass");
+        m_memory_floor = true;
+        return 0;
+    }
+
+    const memory_default_entry_t *entry = find_memory_default(avctx->codec_id);
+    bool frame_threads = entry ? entry->frame_threads : false;
+    bool set_refs = (avctx->codec_id == AV_CODEC_ID_H264);
+    int lookahead = m_vlookahead;
+    int threads = m_vthreads;
+    int refs = m_vrefs;
+    FFMemoryUsage usage = m_vusage;
+    while (m_vusage.total() - usage.total() < over) {
+        if (lookahead > 0) {
+            lookahead /= 2;
+        }else if (threads > 1) {
+            threads /= 2;
+        }else if (set_refs && refs > 1) {
+            refs--;
+        }else {
+            break;
+        }
+        estimate_memory(avctx, lookahead, refs, threads, frame_threads, usage);
+    }
+    if (lookahead == m_vlookahead && threads == m_vthreads && refs == m_vrefs) {
+        LOGW("over memory_cap="<<m_memory_cap<<" by "<<over<<", and no setting to shrink");
+        m_memory_floor = true;
+        return 0;
+    }
+
+    // drain delayed frames of current codec
+    for (;;) {
+        AVPacket pkt;
+        av_init_packet(&pkt);
+        pkt.data = NULL;
+        pkt.size = 0;
+        int got_output = 0;
+        int iret = avcodec_encode_video2(avctx, &pkt, NULL, &got_output);
+        if (iret < 0 || got_output <= 0)
+            break;
+        pushPacket(pkt);
+        av_packet_unref(&pkt);
+    }
+    m_vtimes.clear();
+    m_vdts.clear();
+
+    // same size and format, so input conversion is kept
+    int64_t scaler = m_vusage.scaler;
+    avcodec_free_context(&pCodec->avctx);
+    pCodec->avctx = avcodec_alloc_context3(pCodec->codec);
+    returnv_if_fail(pCodec->avctx, -1);
+    m_vlookahead = lookahead;
+    m_vthreads = threads;
+    m_vrefs = refs;
+    m_vshrink = true;
+    long lret = openCodec(m_video, m_vopen_fmt);
+    m_vshrink = false;
+    m_vusage.scaler = scaler;
+    if (lret != 0) {
+        LOGE("fail to reopen for memory_cap="<<m_memory_cap);
+        return -1;
+    }
+    return 0;
+}
+
 // return 0 if success, else < 0
 long FFEncoder::encodeVideo(const uint8_t *in_data, int in_size, const FFVideoFormat &in_fmt, 
         uint8_t *out_data, int &out_size) {
+    FFTimeInfo out_info;
+    int size = out_size;
+    long lret = encodeVideo(in_data, in_size, in_fmt, FFTimeInfo(), out_data, size, out_info);
+    returnv_if_fail(lret == 0, lret);
+    if (size <= 0) {
+        if (in_data) {
+            LOGE("no output for delayed frame");
+        }else {
+            LOGW("no delayed frames and donot flush again");
+        }
+        return -1;
+    }
+    out_size = size;
+    return 0;
+}
+
+// return 0 if success, else < 0
+long FFEncoder::encodeVideo(const uint8_t *in_data, const int in_size, const FFVideoFormat &in_fmt, const FFTimeInfo &in_info,
+        uint8_t *out_data, int &out_size, FFTimeInfo &out_info) {
     returnv_if_fail(m_video, -1);
     returnv_if_fail(out_data, -1);
+    out_info.reset();
 
     FFCodec *pCodec = (FFCodec *)m_video;
 
@@ -151,55 +999,51 @@ long FFEncoder::encodeVideo(const uint8_t *in_data, int in_size, const FFVideoFo
     pCodec->avpkt.data = out_data;
     pCodec->avpkt.size = out_size;
     
-    // flush delayed frames
+    // flush delayed frames, and packets drained by shrinkMemory first
     if (!in_data) {
+        if (!m_vpending.empty())
+            return popPacket(out_data, out_size, out_info);
         int got_output = 0;
         int iret = avcodec_encode_video2(pCodec->avctx, &pCodec->avpkt, NULL, &got_output);
         if (iret < 0 || got_output <= 0) {
-            LOGW("no delayed frames and donot flush again, return="<<iret);
-            return -1;
+            while (measureQuality(NULL, 0, AV_NOPTS_VALUE) > 0) {} // drain reconstructed frames
+            m_vtimes.clear();
+            m_vdts.clear();
+            out_size = 0;
+            returnv_if_fail(iret >= 0, -1);
+            return 0;
         }
         out_size = pCodec->avpkt.size;
+        popTimeInfo(pCodec->avpkt, out_info);
+        deliverSlices(pCodec->avpkt.data, out_size);
+        measureQuality(pCodec->avpkt.data, out_size, pCodec->avpkt.pts);
         return 0;
     }
 
-    // check input format
-    AVPixelFormat in_pix_fmt = GetAVPixelFormat(in_fmt.pix_fmt);
-    if (in_pix_fmt == AV_PIX_FMT_NONE) {
-        LOGE("unsupported format ff_pix_fmt="<<in_fmt.pix_fmt);
-        return -1;
+    // check input format only when it changes
+    if (m_vfmt.width != in_fmt.width || 
+        m_vfmt.height != in_fmt.height || 
+        m_vfmt.pix_fmt != in_fmt.pix_fmt) {
+        long lret = prepareInput(in_fmt);
+        if (lret != 0) {
+            m_vfmt.reset();
+            return lret;
+        }
+        m_vfmt = in_fmt;
     }
+    AVPixelFormat in_pix_fmt = m_in_pix_fmt;
 
     // prepare input frame
     AVFrame *input_frame = NULL;
-    if (in_pix_fmt != pCodec->avctx->pix_fmt || 
-        in_fmt.width != pCodec->avctx->width || 
-        in_fmt.height != pCodec->avctx->height) {
-        // convert pix_fmt
-        if (!sws_isSupportedInput(in_pix_fmt) || !sws_isSupportedOutput(pCodec->avctx->pix_fmt)) {
-            LOGE("(sws) unsupported from av_pix_fmt="<<in_pix_fmt<<" to av_pix_fmt="<<pCodec->avctx->pix_fmt);
-            return -1;
-        }
-
-        if (m_vfmt.width != in_fmt.width || 
-            m_vfmt.height != in_fmt.height || 
-            m_vfmt.pix_fmt != in_fmt.pix_fmt) {
-            m_vfmt = in_fmt;
-            sws_freeContext(pCodec->swsctx);
-            pCodec->swsctx = sws_getContext(in_fmt.width, in_fmt.height, in_pix_fmt,
-                pCodec->avctx->width, pCodec->avctx->height, pCodec->avctx->pix_fmt, SWS_FAST_BILINEAR,
-                NULL, NULL, NULL);
-        }
-        returnv_if_fail(pCodec->swsctx, -1);
-
+    if (m_in_convert) {
         // prepare sws output frame
         if (!pCodec->frame2) {
             pCodec->frame2 = av_frame_alloc();
             pCodec->frame2->width = pCodec->avctx->width;
             pCodec->frame2->height = pCodec->avctx->height;
             pCodec->frame2->format = pCodec->avctx->pix_fmt;
-            int iret = av_frame_get_buffer(pCodec->frame2, 0);
-            returnv_if_fail(iret==0, -1);
+            long lret = pCodec->arena.allocFrame(pCodec->frame2);
+            returnv_if_fail(lret==0, -1);
         }
 
         // prepare sws input data
@@ -209,10 +1053,15 @@ long FFEncoder::encodeVideo(const uint8_t *in_data, int in_size, const FFVideoFo
                 in_data, in_pix_fmt, in_fmt.width, in_fmt.height, 0);
         returnv_if_fail(iret > 0 && iret <= in_size, -1);
 
-        // sws convert (for input frame)
-        iret = sws_scale(pCodec->swsctx, sws_in_data, sws_in_linesize, 0, in_fmt.height,
-                pCodec->frame2->data, pCodec->frame2->linesize);
-        returnv_if_fail(iret == in_fmt.height, -1);
+        // convert (for input frame)
+        if (m_in_converter) {
+            m_in_converter(sws_in_data, sws_in_linesize, pCodec->frame2->data, pCodec->frame2->linesize,
+                    in_fmt.width, in_fmt.height);
+        }else {
+            iret = sws_scale(pCodec->swsctx, sws_in_data, sws_in_linesize, 0, in_fmt.height,
+                    pCodec->frame2->data, pCodec->frame2->linesize);
+            returnv_if_fail(iret == in_fmt.height, -1);
+        }
 
         input_frame = pCodec->frame2;
     }else {
@@ -231,14 +1080,47 @@ long FFEncoder::encodeVideo(const uint8_t *in_data, int in_size, const FFVideoFo
         input_frame = pCodec->frame;
     }
 
+    // input scaler and buffers may grow over memory_cap
+    if (m_memory_cap > 0 && !m_memory_floor && getMemoryUsage() > m_memory_cap) {
+        returnv_if_fail(shrinkMemory() == 0, -1);
+        av_init_packet(&pCodec->avpkt);
+        pCodec->avpkt.data = out_data;
+        pCodec->avpkt.size = out_size;
+    }
+
+    if (m_scene) {
+        placeKeyframe(input_frame);
+    }
+    // codec pts is input index(strictly increasing), and mapped back to in_info at output
+    input_frame->pts = m_vpts++;
+    pushTimeInfo(input_frame->pts, in_info);
+    if (m_recon && input_frame->pts % m_quality_interval == 0) {
+        keepQualityFrame(input_frame);
+    }
+
     // encode frame
     int got_output = 0;
     int iret = avcodec_encode_video2(pCodec->avctx, &pCodec->avpkt, input_frame, &got_output);
-    if (iret < 0 || got_output <= 0) {
-        LOGE("encode failure or no output, return="<<iret);
+    if (iret < 0) {
+        LOGE("encode failure, return="<<iret);
+        m_vtimes.erase(input_frame->pts);
+        m_vdts.pop_back();
         return -1;
     }
+    if (!m_vpending.empty()) {
+        // after packets drained by shrinkMemory
+        if (got_output > 0)
+            pushPacket(pCodec->avpkt);
+        return popPacket(out_data, out_size, out_info);
+    }
+    if (got_output <= 0) {
+        out_size = 0;
+        return 0;
+    }
     out_size = pCodec->avpkt.size;
+    popTimeInfo(pCodec->avpkt, out_info);
+    deliverSlices(pCodec->avpkt.data, out_size);
+    measureQuality(pCodec->avpkt.data, out_size, pCodec->avpkt.pts);
 
     return 0;
 }
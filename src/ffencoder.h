@@ -2,6 +2,24 @@
 #define __FFENCODER_H_
 
 #include "ffparam.h"
+#include "ffplace.h"
+#include <vector>
+#include <deque>
+#include <map>
+
+class FFSceneDetector;
+
+// called for each slice of an encoded frame in stream order, before encodeVideo returns.
+// h264: VCL NAL with its preceding parameter sets/SEI, vp8: frame header with first partition,
+// then each token partition, others: whole packet.
+// this is not sub-frame output: libavcodec returns whole frames only(no x264 nalu_process or
+// libvpx output partitions), so slices are split after the frame is encoded and sending cannot
+// overlap with encoding. data.slices/slice_max_size give a low-delay encoder(no lookahead/b-frames,
+// one packet per input frame) with slices ready for packetization.
+typedef void (*FFSliceCallback)(void *opaque, const uint8_t *data, int size, int index, bool last);
+
+// called for each measured frame in output order of the reconstructed frames
+typedef void (*FFQualityCallback)(void *opaque, const FFQualityStats &stats);
 
 class FF_EXPORT FFEncoder
 {
@@ -9,24 +27,113 @@ public:
     FFEncoder();
     virtual ~FFEncoder();
 
+    // cpus and numa node for next openVideo(codec threads and frame buffers)
+    void setPlacement(const FFPlacement &placement);
+    const FFPlacement &getPlacement() const;    // resolved placement of opened video
+
     long openVideo(FFCodecID codec_id, const FFVideoFormat &format);
     void closeVideo();
     long encodeVideo(const uint8_t *in_data, const int in_size, const FFVideoFormat &in_fmt,
             uint8_t *out_data, int &out_size);
 
+    // in_info(pts is the input index if unknown) is carried to the packet of this frame, and
+    // out_info.dts is from input pts in input order. return 0 if success, and out_size is 0
+    // if the frame is delayed(b-frames/lookahead/threads), or drained when flushing by NULL input.
+    long encodeVideo(const uint8_t *in_data, const int in_size, const FFVideoFormat &in_fmt, const FFTimeInfo &in_info,
+            uint8_t *out_data, int &out_size, FFTimeInfo &out_info);
+    int getVideoDelay() const;  // frames input but not output yet
+    long getVideoExtradata(const uint8_t *&data, int &size);
+    void setSliceCallback(FFSliceCallback callback, void *opaque);
+
+    // measure psnr/ssim of every frame_interval-th frame by decoding output(after openVideo),
+    // pixel_step(>1) subsamples rows and blocks, and NULL callback disables it.
+    // every output packet is still fully decoded(references are needed), which costs about
+    // one decode per frame, and frame_interval/pixel_step only reduce the metric part.
+    long setQualityCallback(FFQualityCallback callback, void *opaque, int frame_interval = 1, int pixel_step = 1);
+
+    // scene analysis of last input frame, for data.scene_detect
+    const FFSceneInfo &getSceneInfo() const;
+
+    // stats are collected when closing first pass(after flushing), and used by second pass
+    const FFPassStats &getPassStats() const;
+    void setPassStats(const FFPassStats &stats);
+
     long openAudio(FFCodecID codec_id, const FFAudioFormat &format);
     void closeAudio();
     long encodeAudio(const uint8_t *in_data, const int in_size, uint8_t *out_data, int &out_size);
+    long getAudioExtradata(const uint8_t *&data, int &size);
+
+    // memory of sessions, and video settings are shrunk to fit data.memory_cap(see FFVideoFormat)
+    int64_t getMemoryUsage();
+    void getMemoryUsage(FFMemoryUsage &usage);
 
 protected:
     long openContext(ff_codec_t codec, FFCodecID codec_id);
     long openCodec(ff_codec_t codec, const FFVideoFormat &format);
     long openCodec(ff_codec_t codec, const FFAudioFormat &format);
+    long getExtradata(ff_codec_t codec, const uint8_t *&data, int &size);
+    long setRateControl(ff_codec_t codec, const FFVideoFormat &format);
+    long setMemoryBudget(ff_codec_t codec, const FFVideoFormat &format);
+    long setSlices(ff_codec_t codec, const FFVideoFormat &format);
+    void deliverSlices(const uint8_t *data, int size);
+    long setSceneDetect(ff_codec_t codec, const FFVideoFormat &format);
+    void placeKeyframe(AVFrame *frame);
+    struct QualityFrame;
+    void keepQualityFrame(const AVFrame *frame);
+    long measureQuality(const uint8_t *data, int size, int64_t pts);
+    void closeQuality();
+    long prepareInput(const FFVideoFormat &in_fmt);
+    void pushTimeInfo(int64_t index, const FFTimeInfo &info);
+    void popTimeInfo(const AVPacket &pkt, FFTimeInfo &info);
+    long shrinkMemory();
+    void pushPacket(const AVPacket &pkt);
+    long popPacket(uint8_t *out_data, int &out_size, FFTimeInfo &out_info);
+
+    struct PendingPacket {
+        std::vector<uint8_t> data;
+        int64_t pts;        // input index
+        FFTimeInfo info;
+    };
 
 private:
     ff_codec_t m_video;
     ff_codec_t m_audio;
-    FFVideoFormat m_vfmt;
+    FFVideoFormat m_vfmt;       // validated input format
+    AVPixelFormat m_in_pix_fmt;
+    bool m_in_convert;          // convert for input
+    ff_convert_func m_in_converter; // specialized for same size, else sws
+    FFPassStats m_pass_stats;
+    std::string m_stats_file;   // x264 stats are only file-based
+    FFMemoryUsage m_vusage;     // estimated components of video session
+    int64_t m_memory_cap;
+    bool m_memory_floor;        // nothing more to shrink
+    bool m_vshrink;             // reopening by shrinkMemory
+    int m_vlookahead;           // settings of memory estimate
+    int m_vthreads;
+    int m_vrefs;
+    FFVideoFormat m_vopen_fmt;  // format of openVideo, for reopening
+    std::deque<PendingPacket> m_vpending;   // drained before reopening
+    FFSliceCallback m_slice_callback;
+    void *m_slice_opaque;
+    int m_vp8_partitions;       // token partitions per frame
+    int64_t m_vpts;             // input frame index
+    std::map<int64_t, FFTimeInfo> m_vtimes; // input index to its info, until output
+    std::deque<int64_t> m_vdts; // input pts in input order, for output dts
+    int64_t m_vdts_index;       // input index of m_vdts.front()
+    FFQualityCallback m_quality_callback;
+    void *m_quality_opaque;
+    int m_quality_interval;
+    int m_quality_step;
+    ff_codec_t m_recon;         // decoder of reconstructed frames
+    std::deque<QualityFrame *> m_quality_frames;    // input luma waiting for recon
+    std::vector<QualityFrame *> m_quality_pool;
+    FFSceneDetector *m_scene;
+    FFSceneInfo m_scene_info;
+    int m_gop_size;
+    int m_max_gop_size;
+    int m_gop_frames;           // frames of current gop, < 0 before the first
+    FFPlacement m_placement;    // requested
+    FFPlacement m_vplace;       // resolved for video session
 };
 
 #endif //__FFENCODER_H_
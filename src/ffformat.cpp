@@ -0,0 +1,528 @@
+#include "ffformat.h"
+#include "ffdecoder.h"
+#include "fflog.h"
+#include "ffcodec.h"
+
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define IO_BUFFER_SIZE  32768
+#define READ_AHEAD_SIZE (1024*1024)
+
+static const AVRational k_ms_time_base = {1, 1000};
+
+static pthread_once_t s_register_once = PTHREAD_ONCE_INIT;
+static void register_formats() {
+    av_register_all();
+}
+
+
+// for memory source
+typedef struct mem_source_t {
+    const uint8_t *data;
+    int64_t size;
+    int64_t pos;
+}mem_source_t;
+
+static int mem_source_read(void *opaque, uint8_t *buf, int buf_size) {
+    mem_source_t *io = (mem_source_t *)opaque;
+    int64_t left = io->size - io->pos;
+    if (left <= 0)
+        return AVERROR_EOF;
+    int size = (int)FFMIN((int64_t)buf_size, left);
+    memcpy(buf, io->data + io->pos, size);
+    io->pos += size;
+    return size;
+}
+
+static int64_t mem_source_seek(void *opaque, int64_t offset, int whence) {
+    mem_source_t *io = (mem_source_t *)opaque;
+    int64_t pos = -1;
+    switch(whence & ~AVSEEK_FORCE) {
+        case AVSEEK_SIZE:
+            return io->size;
+        case SEEK_SET:
+            pos = offset;
+            break;
+        case SEEK_CUR:
+            pos = io->pos + offset;
+            break;
+        case SEEK_END:
+            pos = io->size + offset;
+            break;
+        default:
+            return AVERROR(EINVAL);
+    }
+    returnv_if_fail(pos >= 0 && pos <= io->size, AVERROR(EINVAL));
+    io->pos = pos;
+    return pos;
+}
+
+
+// for memory or file sink
+typedef struct sink_t {
+    int fd;         // file if >= 0, else memory
+    uint8_t *data;
+    int64_t size;
+    int64_t capacity;
+    int64_t pos;
+}sink_t;
+
+static int sink_write(void *opaque, uint8_t *buf, int buf_size) {
+    sink_t *io = (sink_t *)opaque;
+    if (io->fd >= 0) {
+        ssize_t written = write(io->fd, buf, buf_size);
+        returnv_if_fail(written == buf_size, AVERROR(EIO));
+        io->pos += written;
+        io->size = FFMAX(io->size, io->pos);
+        return buf_size;
+    }
+
+    int64_t end = io->pos + buf_size;
+    if (end > io->capacity) {
+        int64_t capacity = FFMAX(end, io->capacity * 2);
+        uint8_t *data = (uint8_t *)av_realloc(io->data, capacity);
+        returnv_if_fail(data, AVERROR(ENOMEM));
+        io->data = data;
+        io->capacity = capacity;
+    }
+    memcpy(io->data + io->pos, buf, buf_size);
+    io->pos = end;
+    io->size = FFMAX(io->size, io->pos);
+    return buf_size;
+}
+
+static int64_t sink_seek(void *opaque, int64_t offset, int whence) {
+    sink_t *io = (sink_t *)opaque;
+    int64_t pos = -1;
+    switch(whence & ~AVSEEK_FORCE) {
+        case AVSEEK_SIZE:
+            return io->size;
+        case SEEK_SET:
+            pos = offset;
+            break;
+        case SEEK_CUR:
+            pos = io->pos + offset;
+            break;
+        case SEEK_END:
+            pos = io->size + offset;
+            break;
+        default:
+            return AVERROR(EINVAL);
+    }
+    returnv_if_fail(pos >= 0, AVERROR(EINVAL));
+    if (io->fd >= 0) {
+        returnv_if_fail(lseek(io->fd, pos, SEEK_SET) == pos, AVERROR(EIO));
+    }else {
+        returnv_if_fail(pos <= io->size, AVERROR(EINVAL));
+    }
+    io->pos = pos;
+    return pos;
+}
+
+static int64_t rescale_ts(int64_t ts, AVRational from, AVRational to) {
+    if (ts == AV_NOPTS_VALUE)
+        return AV_NOPTS_VALUE;
+    return av_rescale_q(ts, from, to);
+}
+
+
+FFReader::FFReader() {
+    m_fmtctx = NULL;
+    m_avio = NULL;
+    m_io = NULL;
+    m_map = NULL;
+    m_map_size = 0;
+    m_read_ahead = READ_AHEAD_SIZE;
+    av_init_packet(&m_avpkt);
+    m_avpkt.data = NULL;
+    m_avpkt.size = 0;
+}
+
+FFReader::~FFReader() {
+    close();
+}
+
+void FFReader::setReadAhead(int max_bytes) {
+    m_read_ahead = max_bytes;
+}
+
+// return 0 if success, else < 0
+long FFReader::open(const uint8_t *data, int64_t size, const char *format) {
+    returnv_if_fail(!m_fmtctx, 1); // opened
+    returnv_if_fail(data && size > 0, -1);
+
+    mem_source_t *io = new mem_source_t;
+    io->data = data;
+    io->size = size;
+    io->pos = 0;
+    m_io = io;
+
+    long lret = openInput(format);
+    if (lret != 0) {
+        LOGE("fail to open input format="<<(format ? format : "auto")<<", return="<<lret);
+        close();
+    }
+    return lret;
+}
+
+// return 0 if success, else < 0
+long FFReader::openFile(const char *path, const char *format) {
+    returnv_if_fail(!m_fmtctx && !m_map, 1); // opened
+    returnv_if_fail(path, -1);
+
+    int fd = ::open(path, O_RDONLY);
+    returnv_if_fail(fd >= 0, -1);
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        ::close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    returnv_if_fail(map != MAP_FAILED, -1);
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    m_map = map;
+    m_map_size = st.st_size;
+
+    long lret = open((const uint8_t *)m_map, m_map_size, format);
+    if (lret != 0) {
+        close();
+    }
+    return lret;
+}
+
+long FFReader::openInput(const char *format) {
+    pthread_once(&s_register_once, register_formats);
+
+    int io_size = FFMAX(4096, FFMIN(IO_BUFFER_SIZE, m_read_ahead));
+    uint8_t *io_buffer = (uint8_t *)av_malloc(io_size);
+    returnv_if_fail(io_buffer, -1);
+    m_avio = avio_alloc_context(io_buffer, io_size, 0, m_io, mem_source_read, NULL, mem_source_seek);
+    if (!m_avio) {
+        av_free(io_buffer);
+        return -1;
+    }
+
+    AVInputFormat *ifmt = NULL;
+    if (format) {
+        ifmt = av_find_input_format(format);
+        returnv_if_fail(ifmt, -1);
+    }
+
+    m_fmtctx = avformat_alloc_context();
+    returnv_if_fail(m_fmtctx, -1);
+    m_fmtctx->pb = m_avio;
+    m_fmtctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+    m_fmtctx->probesize = FFMAX(32, m_read_ahead);
+
+    int iret = avformat_open_input(&m_fmtctx, NULL, ifmt, NULL);
+    if (iret != 0) {
+        m_fmtctx = NULL; // freed by avformat_open_input
+        return -1;
+    }
+
+    iret = avformat_find_stream_info(m_fmtctx, NULL);
+    returnv_if_fail(iret >= 0, -1);
+    return 0;
+}
+
+void FFReader::close() {
+    av_packet_unref(&m_avpkt);
+    if (m_fmtctx) {
+        avformat_close_input(&m_fmtctx);
+        m_fmtctx = NULL;
+    }
+    if (m_avio) {
+        av_freep(&m_avio->buffer);
+        av_freep(&m_avio);
+        m_avio = NULL;
+    }
+    if (m_io) {
+        delete (mem_source_t *)m_io;
+        m_io = NULL;
+    }
+    if (m_map) {
+        munmap(m_map, m_map_size);
+        m_map = NULL;
+        m_map_size = 0;
+    }
+}
+
+int FFReader::getStreamCount() {
+    returnv_if_fail(m_fmtctx, 0);
+    return (int)m_fmtctx->nb_streams;
+}
+
+// return stream index(>=0) if success, else < 0
+int FFReader::findStream(FFMediaType type) {
+    returnv_if_fail(m_fmtctx, -1);
+    AVMediaType codec_type = (type == FF_MEDIA_VIDEO) ? AVMEDIA_TYPE_VIDEO : AVMEDIA_TYPE_AUDIO;
+    for (unsigned int i = 0; i < m_fmtctx->nb_streams; i++) {
+        if (m_fmtctx->streams[i]->codecpar->codec_type == codec_type)
+            return (int)i;
+    }
+    return -1;
+}
+
+FFCodecID FFReader::getCodecID(int stream_index) {
+    returnv_if_fail(m_fmtctx, FF_CODEC_ID_NONE);
+    returnv_if_fail(stream_index >= 0 && stream_index < (int)m_fmtctx->nb_streams, FF_CODEC_ID_NONE);
+    return GetFFCodecID(m_fmtctx->streams[stream_index]->codecpar->codec_id);
+}
+
+// return 0 if success, else < 0
+long FFReader::getVideoFormat(int stream_index, FFVideoFormat &fmt) {
+    returnv_if_fail(m_fmtctx, -1);
+    returnv_if_fail(stream_index >= 0 && stream_index < (int)m_fmtctx->nb_streams, -1);
+
+    AVStream *stream = m_fmtctx->streams[stream_index];
+    AVCodecParameters *par = stream->codecpar;
+    returnv_if_fail(par->codec_type == AVMEDIA_TYPE_VIDEO, -1);
+
+    int fps = 0;
+    if (stream->avg_frame_rate.num > 0 && stream->avg_frame_rate.den > 0)
+        fps = stream->avg_frame_rate.num / stream->avg_frame_rate.den;
+    fmt.set(par->width, par->height, GetFFPixelFormat((AVPixelFormat)par->format), (int)par->bit_rate, fps);
+    return 0;
+}
+
+// return 0 if success, else < 0
+long FFReader::getAudioFormat(int stream_index, FFAudioFormat &fmt) {
+    returnv_if_fail(m_fmtctx, -1);
+    returnv_if_fail(stream_index >= 0 && stream_index < (int)m_fmtctx->nb_streams, -1);
+
+    AVCodecParameters *par = m_fmtctx->streams[stream_index]->codecpar;
+    returnv_if_fail(par->codec_type == AVMEDIA_TYPE_AUDIO, -1);
+
+    fmt.set(par->sample_rate, GetFFSampleFormat((AVSampleFormat)par->format), par->channels, (int)par->bit_rate);
+    return 0;
+}
+
+// open decoder with the stream's codec and extradata, return 0 if success, else < 0
+long FFReader::openDecoder(int stream_index, FFDecoder &decoder) {
+    returnv_if_fail(m_fmtctx, -1);
+    returnv_if_fail(stream_index >= 0 && stream_index < (int)m_fmtctx->nb_streams, -1);
+
+    AVCodecParameters *par = m_fmtctx->streams[stream_index]->codecpar;
+    FFCodecID codec_id = GetFFCodecID(par->codec_id);
+    if (codec_id == FF_CODEC_ID_NONE) {
+        LOGE("unsupported av_codec_id="<<par->codec_id);
+        return -1;
+    }
+
+    if (par->codec_type == AVMEDIA_TYPE_VIDEO)
+        return decoder.openVideo(codec_id, par->extradata, par->extradata_size);
+    else if (par->codec_type == AVMEDIA_TYPE_AUDIO)
+        return decoder.openAudio(codec_id, par->extradata, par->extradata_size);
+    return -1;
+}
+
+// return 0 if success, 1 if eof, else < 0
+long FFReader::readPacket(FFPacket &pkt) {
+    returnv_if_fail(m_fmtctx, -1);
+
+    pkt.reset();
+    av_packet_unref(&m_avpkt);
+    int iret = av_read_frame(m_fmtctx, &m_avpkt);
+    if (iret == AVERROR_EOF)
+        return 1;
+    returnv_if_fail(iret >= 0, -1);
+
+    AVRational time_base = m_fmtctx->streams[m_avpkt.stream_index]->time_base;
+    pkt.stream_index = m_avpkt.stream_index;
+    pkt.data = m_avpkt.data;
+    pkt.size = m_avpkt.size;
+    pkt.pts = rescale_ts(m_avpkt.pts, time_base, k_ms_time_base);
+    pkt.dts = rescale_ts(m_avpkt.dts, time_base, k_ms_time_base);
+    pkt.keyframe = (m_avpkt.flags & AV_PKT_FLAG_KEY) != 0;
+    return 0;
+}
+
+
+FFWriter::FFWriter() {
+    m_fmtctx = NULL;
+    m_avio = NULL;
+    m_io = NULL;
+    m_header = false;
+}
+
+FFWriter::~FFWriter() {
+    close();
+}
+
+// return 0 if success, else < 0
+long FFWriter::open(const char *format, const char *path) {
+    returnv_if_fail(!m_fmtctx, 1); // opened
+    returnv_if_fail(format || path, -1);
+    pthread_once(&s_register_once, register_formats);
+
+    sink_t *io = new sink_t;
+    memset(io, 0, sizeof(sink_t));
+    io->fd = -1;
+    m_io = io;
+    if (path) {
+        io->fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (io->fd < 0) {
+            LOGE("fail to create file="<<path);
+            close();
+            return -1;
+        }
+    }
+
+    int iret = avformat_alloc_output_context2(&m_fmtctx, NULL, format, path);
+    if (iret < 0 || !m_fmtctx) {
+        LOGE("fail to alloc output format="<<(format ? format : "auto")<<", return="<<iret);
+        close();
+        return -1;
+    }
+
+    uint8_t *io_buffer = (uint8_t *)av_malloc(IO_BUFFER_SIZE);
+    if (io_buffer) {
+        m_avio = avio_alloc_context(io_buffer, IO_BUFFER_SIZE, 1, m_io, NULL, sink_write, sink_seek);
+    }
+    if (!m_avio) {
+        av_free(io_buffer);
+        close();
+        return -1;
+    }
+    m_fmtctx->pb = m_avio;
+    m_fmtctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+    return 0;
+}
+
+void FFWriter::close() {
+    if (m_header) {
+        finish();
+    }
+    if (m_fmtctx) {
+        avformat_free_context(m_fmtctx);
+        m_fmtctx = NULL;
+    }
+    if (m_avio) {
+        av_freep(&m_avio->buffer);
+        av_freep(&m_avio);
+        m_avio = NULL;
+    }
+    if (m_io) {
+        sink_t *io = (sink_t *)m_io;
+        if (io->fd >= 0)
+            ::close(io->fd);
+        av_free(io->data);
+        delete io;
+        m_io = NULL;
+    }
+}
+
+AVStream *FFWriter::newStream(FFCodecID codec_id, const uint8_t *extradata, int extradata_size) {
+    returnv_if_fail(m_fmtctx && !m_header, NULL);
+
+    AVCodecID av_codec_id = GetAVCodecID(codec_id);
+    returnv_if_fail(av_codec_id != AV_CODEC_ID_NONE, NULL);
+
+    AVStream *stream = avformat_new_stream(m_fmtctx, NULL);
+    returnv_if_fail(stream, NULL);
+    stream->time_base = k_ms_time_base;
+    stream->codecpar->codec_id = av_codec_id;
+
+    if (extradata && extradata_size > 0) {
+        stream->codecpar->extradata = (uint8_t *)av_mallocz(extradata_size + AV_INPUT_BUFFER_PADDING_SIZE);
+        returnv_if_fail(stream->codecpar->extradata, NULL);
+        memcpy(stream->codecpar->extradata, extradata, extradata_size);
+        stream->codecpar->extradata_size = extradata_size;
+    }else if (m_fmtctx->oformat->flags & AVFMT_GLOBALHEADER) {
+        LOGW("no extradata for format="<<m_fmtctx->oformat->name<<", and codec should use global_header");
+    }
+    return stream;
+}
+
+int FFWriter::addVideoStream(FFCodecID codec_id, const FFVideoFormat &fmt,
+        const uint8_t *extradata, int extradata_size) {
+    AVStream *stream = newStream(codec_id, extradata, extradata_size);
+    returnv_if_fail(stream, -1);
+
+    AVCodecParameters *par = stream->codecpar;
+    par->codec_type = AVMEDIA_TYPE_VIDEO;
+    par->width = fmt.width;
+    par->height = fmt.height;
+    par->format = GetAVPixelFormat(fmt.pix_fmt);
+    par->bit_rate = fmt.bitrate;
+    if (fmt.fps > 0) {
+        stream->avg_frame_rate = (AVRational){fmt.fps, 1};
+    }
+    return stream->index;
+}
+
+int FFWriter::addAudioStream(FFCodecID codec_id, const FFAudioFormat &fmt,
+        const uint8_t *extradata, int extradata_size) {
+    AVStream *stream = newStream(codec_id, extradata, extradata_size);
+    returnv_if_fail(stream, -1);
+
+    AVCodecParameters *par = stream->codecpar;
+    par->codec_type = AVMEDIA_TYPE_AUDIO;
+    par->sample_rate = fmt.sample_rate;
+    par->channels = fmt.channels;
+    par->channel_layout = (fmt.channels == 2) ? AV_CH_LAYOUT_STEREO : AV_CH_LAYOUT_MONO;
+    par->format = GetAVSampleFormat(fmt.sample_fmt);
+    par->bit_rate = fmt.bitrate;
+    return stream->index;
+}
+
+// the packet data is passed to muxer without copy, return 0 if success, else < 0
+long FFWriter::writePacket(const FFPacket &pkt) {
+    returnv_if_fail(m_fmtctx, -1);
+    returnv_if_fail(pkt.data && pkt.size > 0, -1);
+    returnv_if_fail(pkt.stream_index >= 0 && pkt.stream_index < (int)m_fmtctx->nb_streams, -1);
+
+    if (!m_header) {
+        int iret = avformat_write_header(m_fmtctx, NULL);
+        if (iret < 0) {
+            LOGE("fail to write header, return="<<iret);
+            return -1;
+        }
+        m_header = true;
+    }
+
+    AVRational time_base = m_fmtctx->streams[pkt.stream_index]->time_base;
+    AVPacket avpkt;
+    av_init_packet(&avpkt);
+    avpkt.data = (uint8_t *)pkt.data;
+    avpkt.size = pkt.size;
+    avpkt.stream_index = pkt.stream_index;
+    avpkt.pts = rescale_ts(pkt.pts, k_ms_time_base, time_base);
+    avpkt.dts = rescale_ts(pkt.dts != AV_NOPTS_VALUE ? pkt.dts : pkt.pts, k_ms_time_base, time_base);
+    if (pkt.keyframe)
+        avpkt.flags |= AV_PKT_FLAG_KEY;
+
+    int iret = av_write_frame(m_fmtctx, &avpkt);
+    if (iret < 0) {
+        LOGE("fail to write packet, return="<<iret);
+        return -1;
+    }
+    return 0;
+}
+
+// write trailer, return 0 if success, else < 0
+long FFWriter::finish() {
+    returnv_if_fail(m_fmtctx, -1);
+    returnv_if_fail(m_header, -1);
+    m_header = false;
+
+    int iret = av_write_trailer(m_fmtctx);
+    avio_flush(m_avio);
+    returnv_if_fail(iret == 0, -1);
+    return 0;
+}
+
+const uint8_t *FFWriter::getData(int64_t &size) {
+    sink_t *io = (sink_t *)m_io;
+    size = 0;
+    returnv_if_fail(io && io->fd < 0, NULL);
+    size = io->size;
+    return io->data;
+}
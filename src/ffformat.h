@@ -0,0 +1,101 @@
+#ifndef __FFFORMAT_H_
+#define __FFFORMAT_H_
+
+#include "ffparam.h"
+
+class FFDecoder;
+
+// demuxed/muxed packet, data is not copied
+class FFPacket {
+public:
+    FFPacket() {
+        reset();
+    }
+    void reset() {
+        stream_index = -1;
+        data = NULL;
+        size = 0;
+        pts = dts = AV_NOPTS_VALUE;
+        keyframe = false;
+    }
+
+public:
+    int stream_index;
+    const uint8_t *data;
+    int size;
+    int64_t pts;    // in ms
+    int64_t dts;    // in ms
+    bool keyframe;
+};
+
+// demux mp4/mkv/webm/ivf/annex-b.. from memory or mmap-ed file
+class FF_EXPORT FFReader
+{
+public:
+    FFReader();
+    virtual ~FFReader();
+
+    // max bytes to read ahead(io buffer and probing), must be set before open
+    void setReadAhead(int max_bytes);
+
+    // format: short name(e.g. "h264", "ivf") if it cannot be probed, else NULL
+    long open(const uint8_t *data, int64_t size, const char *format = NULL);
+    long openFile(const char *path, const char *format = NULL);
+    void close();
+
+    int getStreamCount();
+    int findStream(FFMediaType type);
+    FFCodecID getCodecID(int stream_index);
+    long getVideoFormat(int stream_index, FFVideoFormat &fmt);
+    long getAudioFormat(int stream_index, FFAudioFormat &fmt);
+    long openDecoder(int stream_index, FFDecoder &decoder);
+
+    // packet is valid until next reading, return 0 if success, 1 if eof, else < 0
+    long readPacket(FFPacket &pkt);
+
+protected:
+    long openInput(const char *format);
+
+private:
+    AVFormatContext *m_fmtctx;
+    AVIOContext *m_avio;
+    AVPacket m_avpkt;
+    void *m_io;         // memory source
+    void *m_map;        // mmap-ed file
+    int64_t m_map_size;
+    int m_read_ahead;
+};
+
+// mux mp4/mkv/webm/ivf/annex-b.. into memory or file
+class FF_EXPORT FFWriter
+{
+public:
+    FFWriter();
+    virtual ~FFWriter();
+
+    // path: output file, or NULL to keep output in memory
+    long open(const char *format, const char *path);
+    void close();
+
+    // return stream index(>=0) if success, else < 0
+    int addVideoStream(FFCodecID codec_id, const FFVideoFormat &fmt, const uint8_t *extradata, int extradata_size);
+    int addAudioStream(FFCodecID codec_id, const FFAudioFormat &fmt, const uint8_t *extradata, int extradata_size);
+
+    // packets must be in order(not interleaved by writer), return 0 if success, else < 0
+    long writePacket(const FFPacket &pkt);
+    long finish();
+
+    // memory output, valid until close
+    const uint8_t *getData(int64_t &size);
+
+protected:
+    AVStream *newStream(FFCodecID codec_id, const uint8_t *extradata, int extradata_size);
+
+private:
+    AVFormatContext *m_fmtctx;
+    AVIOContext *m_avio;
+    void *m_io;         // memory or file sink
+    bool m_header;      // header has been written
+};
+
+#endif // __FFFORMAT_H_
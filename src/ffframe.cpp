@@ -0,0 +1,200 @@
+#include "ffframe.h"
+#include "fflog.h"
+#include "ffcodec.h"
+
+struct FFFrame::Output {
+    FFVideoFormat fmt;
+    AVPixelFormat pix_fmt;
+    AVFrame *frame;
+    SwsContext *swsctx;
+    bool ready;     // converted for current frame
+};
+
+
+FFFrame::FFFrame() {
+    m_frame = av_frame_alloc();
+    m_fmt.reset();
+}
+
+FFFrame::~FFFrame() {
+    for (size_t i = 0; i < m_outputs.size(); i++) {
+        Output *output = m_outputs[i];
+        av_frame_free(&output->frame);
+        sws_freeContext(output->swsctx);
+        delete output;
+    }
+    m_outputs.clear();
+    av_frame_free(&m_frame);
+}
+
+bool FFFrame::empty() const {
+    FFAutoLock lock(m_mutex);
+    return isEmpty();
+}
+
+bool FFFrame::isEmpty() const {
+    return !m_frame || !m_frame->buf[0];
+}
+
+const FFVideoFormat &FFFrame::getFormat() const {
+    return m_fmt;
+}
+
+long FFFrame::getTimeInfo(FFTimeInfo &info) const {
+    FFAutoLock lock(m_mutex);
+    info.reset();
+    returnv_if_fail(!isEmpty(), -1);
+    GetFrameTimeInfo(m_frame, info);
+    return 0;
+}
+
+void FFFrame::reset() {
+    FFAutoLock lock(m_mutex);
+    clear();
+}
+
+void FFFrame::clear() {
+    if (m_frame)
+        av_frame_unref(m_frame);
+    m_fmt.reset();
+    for (size_t i = 0; i < m_outputs.size(); i++) {
+        m_outputs[i]->ready = false;
+    }
+}
+
+// ref decoded frame(copied only if not refcounted), return 0 if success, else < 0
+long FFFrame::attach(AVFrame *frame) {
+    FFAutoLock lock(m_mutex);
+    clear();
+    returnv_if_fail(m_frame && frame, -1);
+    int iret = av_frame_ref(m_frame, frame);
+    returnv_if_fail(iret == 0, -1);
+
+    m_fmt.width = m_frame->width;
+    m_fmt.height = m_frame->height;
+    m_fmt.pix_fmt = GetFFPixelFormat((AVPixelFormat)m_frame->format);
+    return 0;
+}
+
+FFFrame::Output *FFFrame::getOutput(const FFVideoFormat &fmt) {
+    for (size_t i = 0; i < m_outputs.size(); i++) {
+        Output *output = m_outputs[i];
+        if (output->fmt.width == fmt.width && output->fmt.height == fmt.height &&
+            output->fmt.pix_fmt == fmt.pix_fmt)
+            return output;
+    }
+
+    AVPixelFormat pix_fmt = GetAVPixelFormat(fmt.pix_fmt);
+    returnv_if_fail(pix_fmt != AV_PIX_FMT_NONE && sws_isSupportedOutput(pix_fmt), NULL);
+    returnv_if_fail(fmt.width > 0 && fmt.height > 0, NULL);
+
+    Output *output = new Output;
+    output->fmt.set(fmt.width, fmt.height, fmt.pix_fmt, 0, 0);
+    output->pix_fmt = pix_fmt;
+    output->frame = av_frame_alloc();
+    output->swsctx = NULL;
+    output->ready = false;
+    m_outputs.push_back(output);
+    return output;
+}
+
+// the smallest ready output not smaller than target, prefer the same format on tie.
+// only outputs in target or decoded format are used, to avoid lossy round trips(e.g. yuv->rgb->yuv).
+const AVFrame *FFFrame::findSource(const Output *output) {
+    const AVFrame *source = m_frame;
+    int64_t source_area = (int64_t)m_frame->width * m_frame->height;
+    bool source_same = (m_frame->format == output->pix_fmt);
+
+    for (size_t i = 0; i < m_outputs.size(); i++) {
+        const Output *other = m_outputs[i];
+        if (other == output || !other->ready)
+            continue;
+        if (other->fmt.width < output->fmt.width || other->fmt.height < output->fmt.height)
+            continue;
+        if (other->pix_fmt != output->pix_fmt && other->pix_fmt != m_frame->format)
+            continue;
+        int64_t area = (int64_t)other->fmt.width * other->fmt.height;
+        bool same = (other->pix_fmt == output->pix_fmt);
+        if (area < source_area || (area == source_area && same && !source_same)) {
+            source = other->frame;
+            source_area = area;
+            source_same = same;
+        }
+    }
+    return source;
+}
+
+// return 0 if success, else < 0
+long FFFrame::convert(const AVFrame *src, Output *output) {
+    AVFrame *dst = output->frame;
+
+    // reuse buffer unless a consumer still refs it
+    if (dst->buf[0] && !av_frame_is_writable(dst))
+        av_frame_unref(dst);
+    if (!dst->buf[0]) {
+        dst->format = output->pix_fmt;
+        dst->width = output->fmt.width;
+        dst->height = output->fmt.height;
+        returnv_if_fail(m_arena.allocFrame(dst) == 0, -1);
+    }
+
+    // specialized converter for same size, else sws
+    if (src->width == dst->width && src->height == dst->height) {
+        ff_convert_func convert = GetPixelConverter(GetFFPixelFormat((AVPixelFormat)src->format), output->fmt.pix_fmt);
+        if (convert) {
+            convert(src->data, src->linesize, dst->data, dst->linesize, dst->width, dst->height);
+            return 0;
+        }
+    }
+
+    returnv_if_fail(sws_isSupportedInput((AVPixelFormat)src->format), -1);
+    output->swsctx = sws_getCachedContext(output->swsctx,
+            src->width, src->height, (AVPixelFormat)src->format,
+            dst->width, dst->height, output->pix_fmt, SWS_FAST_BILINEAR,
+            NULL, NULL, NULL);
+    returnv_if_fail(output->swsctx, -1);
+
+    int iret = sws_scale(output->swsctx, src->data, src->linesize, 0, src->height,
+            dst->data, dst->linesize);
+    returnv_if_fail(iret == dst->height, -1); // height of output slice
+    return 0;
+}
+
+// return 0 if success, else < 0
+long FFFrame::getImage(const FFVideoFormat &fmt, const AVFrame *&image) {
+    FFAutoLock lock(m_mutex);
+    return prepareImage(fmt, image);
+}
+
+// convert output at its first request, under m_mutex
+long FFFrame::prepareImage(const FFVideoFormat &fmt, const AVFrame *&image) {
+    returnv_if_fail(!isEmpty(), -1);
+
+    Output *output = getOutput(fmt);
+    returnv_if_fail(output, -1);
+    if (!output->ready) {
+        returnv_if_fail(convert(findSource(output), output) == 0, -1);
+        output->ready = true;
+    }
+    image = output->frame;
+    return 0;
+}
+
+// return 0 if success, else < 0
+long FFFrame::copyImage(const FFVideoFormat &fmt, uint8_t *out_data, int &out_size) {
+    returnv_if_fail(out_data, -1);
+
+    FFAutoLock lock(m_mutex);
+    const AVFrame *image = NULL;
+    returnv_if_fail(prepareImage(fmt, image) == 0, -1);
+
+    AVPixelFormat pix_fmt = (AVPixelFormat)image->format;
+    int size = av_image_get_buffer_size(pix_fmt, image->width, image->height, 1);
+    returnv_if_fail(size > 0 && size <= out_size, -1);
+
+    int iret = av_image_copy_to_buffer(out_data, out_size, image->data, image->linesize,
+            pix_fmt, image->width, image->height, 1);
+    returnv_if_fail(iret > 0, -1);
+    out_size = iret;
+    return 0;
+}
@@ -0,0 +1,54 @@
+#ifndef __FFFRAME_H_
+#define __FFFRAME_H_
+
+#include "ffparam.h"
+#include "ffalloc.h"
+#include "ffthread.h"
+#include <vector>
+
+// decoded video frame shared by many consumers: each output format is converted
+// at its first request only, and kept until next frame. an output is derived from
+// the smallest frame already computed that is not smaller than it(or the decoded one).
+// consumers may request images from many threads, which are serialized by an internal lock.
+class FF_EXPORT FFFrame
+{
+public:
+    FFFrame();
+    virtual ~FFFrame();
+
+    bool empty() const;
+    const FFVideoFormat &getFormat() const; // decoded size and format
+
+    // timestamps and user data of the packet this frame was decoded from, return 0 if success, else < 0
+    long getTimeInfo(FFTimeInfo &info) const;
+
+    // converted image is owned by this and valid until next frame, return 0 if success, else < 0
+    long getImage(const FFVideoFormat &fmt, const AVFrame *&image);
+
+    // copy converted image as packed buffer, out_size: capacity in and image size out
+    long copyImage(const FFVideoFormat &fmt, uint8_t *out_data, int &out_size);
+
+    // release decoded frame, and keep buffers of outputs for next one
+    void reset();
+
+protected:
+    friend class FFDecoder;
+    long attach(AVFrame *frame);
+
+    struct Output;
+    bool isEmpty() const;
+    void clear();
+    long prepareImage(const FFVideoFormat &fmt, const AVFrame *&image);
+    Output *getOutput(const FFVideoFormat &fmt);
+    const AVFrame *findSource(const Output *output);
+    long convert(const AVFrame *src, Output *output);
+
+private:
+    AVFrame *m_frame;
+    FFVideoFormat m_fmt;
+    std::vector<Output *> m_outputs;
+    FFArena m_arena;
+    mutable FFMutex m_mutex;    // guard frame and outputs
+};
+
+#endif // __FFFRAME_H_
@@ -11,6 +11,8 @@ extern "C" {
 #include "libavutil/avutil.h"
 #include "libswscale/swscale.h"
 #include "libavutil/opt.h"
+#include "libavutil/time.h"
+#include "libavutil/cpu.h"
 };
 
 // ffmpeg libs
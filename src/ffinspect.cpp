@@ -0,0 +1,308 @@
+#include "ffinspect.h"
+#include "fflog.h"
+#include "ffcodec.h"
+
+#define H264_NAL_IDR    5
+#define H264_NAL_SPS    7
+
+
+// msb-first bit reader over h264 rbsp, skipping emulation prevention bytes
+struct bit_reader {
+    const uint8_t *data;
+    int size;
+    int byte;
+    int bit;
+    int zeros;      // continuous zero bytes read
+    bool overrun;
+};
+
+static void init_bits(bit_reader &br, const uint8_t *data, int size) {
+    br.data = data;
+    br.size = size;
+    br.byte = 0;
+    br.bit = 0;
+    br.zeros = 0;
+    br.overrun = false;
+}
+
+static inline int read_bit(bit_reader &br) {
+    if (br.byte >= br.size) {
+        br.overrun = true;
+        return 0;
+    }
+    int v = (br.data[br.byte] >> (7 - br.bit)) & 1;
+    if (++br.bit == 8) {
+        br.bit = 0;
+        br.zeros = (br.data[br.byte] == 0) ? br.zeros + 1 : 0;
+        br.byte++;
+        if (br.zeros >= 2 && br.byte < br.size && br.data[br.byte] == 3) {
+            br.byte++;
+            br.zeros = 0;
+        }
+    }
+    return v;
+}
+
+static uint32_t read_bits(bit_reader &br, int n) {
+    uint32_t v = 0;
+    for (int i = 0; i < n; i++) {
+        v = (v << 1) | read_bit(br);
+    }
+    return v;
+}
+
+static uint32_t read_ue(bit_reader &br) {
+    int zeros = 0;
+    while (!read_bit(br) && !br.overrun && zeros < 32) {
+        zeros++;
+    }
+    return zeros >= 32 ? 0 : ((1u << zeros) - 1 + read_bits(br, zeros));
+}
+
+static int32_t read_se(bit_reader &br) {
+    uint32_t v = read_ue(br);
+    return (v & 1) ? (int32_t)((v + 1) >> 1) : -(int32_t)(v >> 1);
+}
+
+static void skip_scaling_list(bit_reader &br, int count) {
+    int last = 8, next = 8;
+    for (int i = 0; i < count && next != 0; i++) {
+        next = (last + read_se(br) + 256) % 256;
+        last = (next == 0) ? last : next;
+    }
+}
+
+static inline int read_be16(const uint8_t *p) {
+    return (p[0] << 8) | p[1];
+}
+
+
+// return 0 if success, else < 0
+long FFPacketInspector::inspect(FFCodecID codec_id, const uint8_t *data, int size, FFPacketInfo &info) {
+    returnv_if_fail(data && size > 0, -1);
+
+    info.reset();
+    info.codec_id = codec_id;
+    info.media_type = GetCodecMediaType(codec_id);
+    info.fourcc = GetCodecFourcc(codec_id);
+
+    switch(codec_id) {
+        case FF_CODEC_ID_H264:
+            return inspectH264(data, size, info);
+        case FF_CODEC_ID_VP8:
+            return inspectVP8(data, size, info);
+        case FF_CODEC_ID_OPUS:
+            return inspectOpus(data, size, info);
+        case FF_CODEC_ID_MJPG:
+            return inspectMJPG(data, size, info);
+        default:
+            return -1;
+    }
+}
+
+static inline int read_be32(const uint8_t *p) {
+    return (int)(((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]);
+}
+
+/* whether 4-byte length prefixed nals consume the packet exactly,
+ * which is checked first since a prefix may look like a start code(e.g. 00 00 01 xx). */
+static bool is_length_prefixed(const uint8_t *data, int size) {
+    int pos = 0;
+    while (pos + 4 < size) {
+        int nal_size = read_be32(data + pos);
+        pos += 4;
+        if (nal_size <= 0 || nal_size > size - pos || (data[pos] & 0x80)) // forbidden_zero_bit
+            return false;
+        pos += nal_size;
+    }
+    return pos == size;
+}
+
+long FFPacketInspector::inspectH264(const uint8_t *data, int size, FFPacketInfo &info) {
+    info.reference = false; // set by referenced slices
+    if (is_length_prefixed(data, size)) {
+        int pos = 0;
+        while (pos < size) {
+            int nal_size = read_be32(data + pos);
+            pos += 4;
+            returnv_if_fail(inspectH264Nal(data + pos, nal_size, info) == 0, -1);
+            pos += nal_size;
+        }
+        return 0;
+    }
+
+    bool annexb = (size >= 3 && data[0] == 0 && data[1] == 0 &&
+            (data[2] == 1 || (size >= 4 && data[2] == 0 && data[3] == 1)));
+    returnv_if_fail(annexb, -1);
+
+    int pos = find_start_code(data, size, 0);
+    while (pos < size) {
+        int start = skip_start_code(data, size, pos);
+        pos = find_start_code(data, size, start);
+        if (pos > start)
+            returnv_if_fail(inspectH264Nal(data + start, pos - start, info) == 0, -1);
+    }
+    return 0;
+}
+
+// idr for keyframe, and resolution from sps(7.3.2.1.1)
+long FFPacketInspector::inspectH264Nal(const uint8_t *nal, int size, FFPacketInfo &info) {
+    int nal_type = nal[0] & 0x1f;
+    if (nal_type >= 1 && nal_type <= H264_NAL_IDR && (nal[0] & 0x60) != 0) {
+        info.reference = true; // nal_ref_idc of slice
+    }
+    if (nal_type == H264_NAL_IDR) {
+        info.keyframe = true;
+        return 0;
+    }
+    if (nal_type != H264_NAL_SPS)
+        return 0;
+
+    bit_reader br;
+    init_bits(br, nal + 1, size - 1);
+    int profile_idc = read_bits(br, 8);
+    read_bits(br, 16); // constraint flags and level_idc
+    read_ue(br); // seq_parameter_set_id
+
+    int chroma_format_idc = 1;
+    bool separate_colour_plane = false;
+    switch(profile_idc) {
+        case 100: case 110: case 122: case 244: case 44:
+        case 83: case 86: case 118: case 128: case 138:
+        case 139: case 134: case 135:
+            chroma_format_idc = read_ue(br);
+            if (chroma_format_idc == 3)
+                separate_colour_plane = read_bit(br);
+            read_ue(br); // bit_depth_luma_minus8
+            read_ue(br); // bit_depth_chroma_minus8
+            read_bit(br); // qpprime_y_zero_transform_bypass_flag
+            if (read_bit(br)) { // seq_scaling_matrix_present_flag
+                for (int i = 0; i < (chroma_format_idc != 3 ? 8 : 12); i++) {
+                    if (read_bit(br))
+                        skip_scaling_list(br, i < 6 ? 16 : 64);
+                }
+            }
+            break;
+        default:
+            break;
+    }
+
+    read_ue(br); // log2_max_frame_num_minus4
+    uint32_t poc_type = read_ue(br);
+    if (poc_type == 0) {
+        read_ue(br); // log2_max_pic_order_cnt_lsb_minus4
+    }else if (poc_type == 1) {
+        read_bit(br); // delta_pic_order_always_zero_flag
+        read_se(br);  // offset_for_non_ref_pic
+        read_se(br);  // offset_for_top_to_bottom_field
+        uint32_t cycle = read_ue(br);
+        for (uint32_t i = 0; i < cycle && !br.overrun; i++) {
+            read_se(br);
+        }
+    }
+    read_ue(br); // max_num_ref_frames
+    read_bit(br); // gaps_in_frame_num_value_allowed_flag
+
+    int width_mbs = read_ue(br) + 1;
+    int height_map_units = read_ue(br) + 1;
+    int frame_mbs_only = read_bit(br);
+    if (!frame_mbs_only)
+        read_bit(br); // mb_adaptive_frame_field_flag
+    read_bit(br); // direct_8x8_inference_flag
+
+    int crop_left = 0, crop_right = 0, crop_top = 0, crop_bottom = 0;
+    if (read_bit(br)) {
+        crop_left = read_ue(br);
+        crop_right = read_ue(br);
+        crop_top = read_ue(br);
+        crop_bottom = read_ue(br);
+    }
+    returnv_if_fail(!br.overrun, -1);
+
+    // crop units by ChromaArrayType
+    int chroma_array_type = separate_colour_plane ? 0 : chroma_format_idc;
+    int crop_x = (chroma_array_type == 1 || chroma_array_type == 2) ? 2 : 1;
+    int crop_y = (2 - frame_mbs_only) * (chroma_array_type == 1 ? 2 : 1);
+
+    info.width = width_mbs * 16 - crop_x * (crop_left + crop_right);
+    info.height = (2 - frame_mbs_only) * height_map_units * 16 - crop_y * (crop_top + crop_bottom);
+    returnv_if_fail(info.width > 0 && info.height > 0, -1);
+    return 0;
+}
+
+// frame tag, and start code with size of key frame(RFC 6386 9.1)
+long FFPacketInspector::inspectVP8(const uint8_t *data, int size, FFPacketInfo &info) {
+    returnv_if_fail(size >= 3, -1);
+    info.keyframe = !(data[0] & 1);
+    if (!info.keyframe)
+        return 0;
+
+    returnv_if_fail(size >= 10, -1);
+    returnv_if_fail(data[3] == 0x9d && data[4] == 0x01 && data[5] == 0x2a, -1);
+    info.width = (data[6] | (data[7] << 8)) & 0x3fff;
+    info.height = (data[8] | (data[9] << 8)) & 0x3fff;
+    return 0;
+}
+
+// toc byte and frame count(RFC 6716 3.1), at most 120ms per packet(3.2.5)
+long FFPacketInspector::inspectOpus(const uint8_t *data, int size, FFPacketInfo &info) {
+    static const int k_frame_duration[32] = { // in 1/10 ms
+        100, 200, 400, 600, 100, 200, 400, 600, 100, 200, 400, 600, // silk
+        100, 200, 100, 200,                                         // hybrid
+        25, 50, 100, 200, 25, 50, 100, 200, 25, 50, 100, 200, 25, 50, 100, 200, // celt
+    };
+
+    uint8_t toc = data[0];
+    int frames = 1;
+    switch(toc & 0x3) {
+        case 0:
+            frames = 1;
+            break;
+        case 1:
+        case 2:
+            frames = 2;
+            break;
+        default:
+            returnv_if_fail(size >= 2, -1);
+            frames = data[1] & 0x3f;
+            break;
+    }
+    returnv_if_fail(frames > 0 && frames * k_frame_duration[toc >> 3] <= 1200, -1);
+
+    info.keyframe = true;
+    info.channels = (toc & 0x4) ? 2 : 1;
+    info.samples = frames * k_frame_duration[toc >> 3] * 48 / 10;
+    return 0;
+}
+
+// markers until SOFn(ITU T.81 B.2)
+long FFPacketInspector::inspectMJPG(const uint8_t *data, int size, FFPacketInfo &info) {
+    returnv_if_fail(size >= 4 && data[0] == 0xff && data[1] == 0xd8, -1);
+    info.keyframe = true;
+
+    int pos = 2;
+    while (pos + 4 <= size) {
+        if (data[pos] != 0xff) {
+            pos++;
+            continue;
+        }
+        uint8_t marker = data[pos+1];
+        if (marker == 0xff || marker == 0x01 || (marker >= 0xd0 && marker <= 0xd7)) {
+            pos += (marker == 0xff) ? 1 : 2; // fill byte or no length
+            continue;
+        }
+        if (marker == 0xda || marker == 0xd9) // SOS or EOI
+            break;
+
+        int length = read_be16(data + pos + 2);
+        bool sof = (marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 && marker != 0xcc);
+        if (sof) {
+            returnv_if_fail(pos + 9 <= size, -1);
+            info.height = read_be16(data + pos + 5);
+            info.width = read_be16(data + pos + 7);
+            return 0;
+        }
+        pos += 2 + length;
+    }
+    return -1;
+}
@@ -0,0 +1,51 @@
+#ifndef __FFINSPECT_H_
+#define __FFINSPECT_H_
+
+#include "ffparam.h"
+
+// properties of one encoded packet, parsed from bitstream headers only
+class FFPacketInfo {
+public:
+    FFPacketInfo() {
+        reset();
+    }
+    void reset() {
+        codec_id = FF_CODEC_ID_NONE;
+        media_type = FF_MEDIA_VIDEO;
+        fourcc = "    ";
+        keyframe = false;
+        reference = true;
+        width = height = 0;
+        channels = 0;
+        samples = 0;
+    }
+
+public:
+    FFCodecID codec_id;
+    FFMediaType media_type;
+    const char *fourcc;     // static string of codec
+    bool keyframe;          // idr(h264), key frame(vp8), and always for opus/mjpg
+    bool reference;         // picture referenced by others(h264 nal_ref_idc), true if unknown
+    int width;              // 0 if not in packet(e.g. h264 without sps, vp8 inter frame)
+    int height;
+    int channels;           // opus
+    int samples;            // opus, per channel at 48kHz
+};
+
+// inspect packets without decoder, allocation or codec context.
+// h264 may be annex-b or 4-byte length prefixed(mp4).
+class FF_EXPORT FFPacketInspector
+{
+public:
+    // return 0 if success, else < 0(unsupported codec or bad header)
+    static long inspect(FFCodecID codec_id, const uint8_t *data, int size, FFPacketInfo &info);
+
+protected:
+    static long inspectH264(const uint8_t *data, int size, FFPacketInfo &info);
+    static long inspectH264Nal(const uint8_t *nal, int size, FFPacketInfo &info);
+    static long inspectVP8(const uint8_t *data, int size, FFPacketInfo &info);
+    static long inspectOpus(const uint8_t *data, int size, FFPacketInfo &info);
+    static long inspectMJPG(const uint8_t *data, int size, FFPacketInfo &info);
+};
+
+#endif // __FFINSPECT_H_
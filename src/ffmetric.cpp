@@ -0,0 +1,160 @@
+#include "ffmetric.h"
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FF_METRIC_SSE2 1
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FF_METRIC_NEON 1
+#endif
+
+#define PSNR_MAX    100.0
+#define SSIM_C1     (0.01 * 255 * 0.01 * 255)
+#define SSIM_C2     (0.03 * 255 * 0.03 * 255)
+
+
+/* sum of squared differences of one row */
+static uint64_t row_sse(const uint8_t *a, const uint8_t *b, int n)
+{
+    uint64_t sse = 0;
+    int i = 0;
+#if defined(FF_METRIC_SSE2)
+    __m128i zero = _mm_setzero_si128();
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a+i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b+i));
+        __m128i lo = _mm_sub_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero));
+        __m128i hi = _mm_sub_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(lo, lo));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(hi, hi));
+    }
+    uint32_t lanes[4];
+    _mm_storeu_si128((__m128i *)lanes, acc);
+    sse = (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#elif defined(FF_METRIC_NEON)
+    uint32x4_t acc = vdupq_n_u32(0);
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t va = vld1q_u8(a+i);
+        uint8x16_t vb = vld1q_u8(b+i);
+        uint8x8_t dlo = vabd_u8(vget_low_u8(va), vget_low_u8(vb));
+        uint8x8_t dhi = vabd_u8(vget_high_u8(va), vget_high_u8(vb));
+        uint16x8_t slo = vmull_u8(dlo, dlo);
+        uint16x8_t shi = vmull_u8(dhi, dhi);
+        acc = vpadalq_u16(acc, slo);
+        acc = vpadalq_u16(acc, shi);
+    }
+    uint64x2_t sum = vpaddlq_u32(acc);
+    sse = vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1);
+#endif
+    for (; i < n; i++) {
+        int d = a[i] - b[i];
+        sse += d * d;
+    }
+    return sse;
+}
+
+/* sums of one 8x8 block: s1 = sum(a), s2 = sum(b), ss = sum(a*a + b*b), s12 = sum(a*b) */
+static void block_sums(const uint8_t *a, int a_stride, const uint8_t *b, int b_stride,
+        uint32_t &s1, uint32_t &s2, uint32_t &ss, uint32_t &s12)
+{
+#if defined(FF_METRIC_SSE2)
+    __m128i zero = _mm_setzero_si128();
+    __m128i sum = _mm_setzero_si128();  // s1 | s2 in 64-bit lanes
+    __m128i sq = _mm_setzero_si128();
+    __m128i cross = _mm_setzero_si128();
+    for (int y = 0; y < 8; y++) {
+        __m128i va = _mm_loadl_epi64((const __m128i *)(a + y * a_stride));
+        __m128i vb = _mm_loadl_epi64((const __m128i *)(b + y * b_stride));
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(_mm_unpacklo_epi64(va, vb), zero));
+        __m128i wa = _mm_unpacklo_epi8(va, zero);
+        __m128i wb = _mm_unpacklo_epi8(vb, zero);
+        sq = _mm_add_epi32(sq, _mm_add_epi32(_mm_madd_epi16(wa, wa), _mm_madd_epi16(wb, wb)));
+        cross = _mm_add_epi32(cross, _mm_madd_epi16(wa, wb));
+    }
+    uint32_t lanes[4];
+    _mm_storeu_si128((__m128i *)lanes, sum);
+    s1 = lanes[0];
+    s2 = lanes[2];
+    _mm_storeu_si128((__m128i *)lanes, sq);
+    ss = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    _mm_storeu_si128((__m128i *)lanes, cross);
+    s12 = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#elif defined(FF_METRIC_NEON)
+    uint16x8_t sa = vdupq_n_u16(0), sb = vdupq_n_u16(0);
+    uint32x4_t sq = vdupq_n_u32(0), cross = vdupq_n_u32(0);
+    for (int y = 0; y < 8; y++) {
+        uint8x8_t va = vld1_u8(a + y * a_stride);
+        uint8x8_t vb = vld1_u8(b + y * b_stride);
+        sa = vaddw_u8(sa, va);
+        sb = vaddw_u8(sb, vb);
+        sq = vpadalq_u16(sq, vmull_u8(va, va));
+        sq = vpadalq_u16(sq, vmull_u8(vb, vb));
+        cross = vpadalq_u16(cross, vmull_u8(va, vb));
+    }
+    uint64x2_t t;
+    t = vpaddlq_u32(vpaddlq_u16(sa));
+    s1 = (uint32_t)(vgetq_lane_u64(t, 0) + vgetq_lane_u64(t, 1));
+    t = vpaddlq_u32(vpaddlq_u16(sb));
+    s2 = (uint32_t)(vgetq_lane_u64(t, 0) + vgetq_lane_u64(t, 1));
+    t = vpaddlq_u32(sq);
+    ss = (uint32_t)(vgetq_lane_u64(t, 0) + vgetq_lane_u64(t, 1));
+    t = vpaddlq_u32(cross);
+    s12 = (uint32_t)(vgetq_lane_u64(t, 0) + vgetq_lane_u64(t, 1));
+#else
+    s1 = s2 = ss = s12 = 0;
+    for (int y = 0; y < 8; y++) {
+        for (int x = 0; x < 8; x++) {
+            int va = a[y * a_stride + x];
+            int vb = b[y * b_stride + x];
+            s1 += va;
+            s2 += vb;
+            ss += va * va + vb * vb;
+            s12 += va * vb;
+        }
+    }
+#endif
+}
+
+double ComputePlanePSNR(const uint8_t *a, int a_stride, const uint8_t *b, int b_stride,
+        int width, int height, int step)
+{
+    if (!a || !b || width <= 0 || height <= 0)
+        return 0;
+    step = FFMAX(step, 1);
+
+    uint64_t sse = 0, count = 0;
+    for (int y = 0; y < height; y += step) {
+        sse += row_sse(a + y * a_stride, b + y * b_stride, width);
+        count += width;
+    }
+    if (sse == 0)
+        return PSNR_MAX;
+    return FFMIN(PSNR_MAX, 10.0 * log10(255.0 * 255.0 * count / sse));
+}
+
+double ComputePlaneSSIM(const uint8_t *a, int a_stride, const uint8_t *b, int b_stride,
+        int width, int height, int step)
+{
+    if (!a || !b || width < 8 || height < 8)
+        return 0;
+    step = FFMAX(step, 1) * 8;
+
+    double total = 0;
+    int count = 0;
+    for (int y = 0; y + 8 <= height; y += step) {
+        for (int x = 0; x + 8 <= width; x += step) {
+            uint32_t s1, s2, ss, s12;
+            block_sums(a + y * a_stride + x, a_stride, b + y * b_stride + x, b_stride, s1, s2, ss, s12);
+
+            double mu1 = s1 / 64.0, mu2 = s2 / 64.0;
+            double var = ss / 64.0 - mu1 * mu1 - mu2 * mu2;  // var1 + var2
+            double cov = s12 / 64.0 - mu1 * mu2;
+            total += ((2 * mu1 * mu2 + SSIM_C1) * (2 * cov + SSIM_C2)) /
+                ((mu1 * mu1 + mu2 * mu2 + SSIM_C1) * (var + SSIM_C2));
+            count++;
+        }
+    }
+    return count > 0 ? total / count : 0;
+}
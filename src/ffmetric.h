@@ -0,0 +1,17 @@
+#ifndef __FFMETRIC_H_
+#define __FFMETRIC_H_
+
+#include "ffparam.h"
+
+// quality metrics of 8-bit planes(e.g. luma) by SIMD kernels.
+// step: use every step-th row(psnr) or 8x8 block in both directions(ssim), 1 for all.
+
+// return psnr in dB(100 for identical planes)
+double ComputePlanePSNR(const uint8_t *a, int a_stride, const uint8_t *b, int b_stride,
+        int width, int height, int step);
+
+// return mean ssim(0..1) of 8x8 blocks
+double ComputePlaneSSIM(const uint8_t *a, int a_stride, const uint8_t *b, int b_stride,
+        int width, int height, int step);
+
+#endif // __FFMETRIC_H_
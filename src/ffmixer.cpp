@@ -0,0 +1,390 @@
+#include "ffmixer.h"
+#include "fflog.h"
+#include "ffcodec.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FF_MIXER_SSE2 1
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FF_MIXER_NEON 1
+#endif
+
+// limiter: attack at once and release slowly(per period)
+#define LIMITER_RELEASE 0.05f
+#define MAX_CARRY_PERIODS 8     // carried samples per stream
+
+
+// for sample conversion
+template<typename T> static inline float sample_to_float(T v);
+template<> inline float sample_to_float<uint8_t>(uint8_t v) { return (v - 128) * (1.0f / 128); }
+template<> inline float sample_to_float<int16_t>(int16_t v) { return v * (1.0f / 32768); }
+template<> inline float sample_to_float<int32_t>(int32_t v) { return v * (1.0f / 2147483648.0f); }
+template<> inline float sample_to_float<float>(float v) { return v; }
+template<> inline float sample_to_float<double>(double v) { return (float)v; }
+
+/* convert frame to interleaved float, with simple up/down mix of channels */
+template<typename T>
+static void convert_frame(const AVFrame *frame, bool planar, int in_channels, int nb_samples,
+        int out_channels, float *out)
+{
+    for (int i = 0; i < nb_samples; i++) {
+        for (int ch = 0; ch < out_channels; ch++) {
+            float v = 0;
+            if (out_channels == 1 && in_channels > 1) {
+                for (int k = 0; k < in_channels; k++) {
+                    T s = planar ? ((const T *)frame->extended_data[k])[i] :
+                        ((const T *)frame->extended_data[0])[i*in_channels+k];
+                    v += sample_to_float<T>(s);
+                }
+                v /= in_channels;
+            }else if (ch < in_channels || in_channels == 1) {
+                int k = FFMIN(ch, in_channels - 1);
+                T s = planar ? ((const T *)frame->extended_data[k])[i] :
+                    ((const T *)frame->extended_data[0])[i*in_channels+k];
+                v = sample_to_float<T>(s);
+            }
+            out[i*out_channels+ch] = v;
+        }
+    }
+}
+
+
+/* dst += src */
+static void mix_add(float *dst, const float *src, int n)
+{
+    int i = 0;
+#if defined(FF_MIXER_SSE2)
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(dst+i, _mm_add_ps(_mm_loadu_ps(dst+i), _mm_loadu_ps(src+i)));
+    }
+#elif defined(FF_MIXER_NEON)
+    for (; i + 4 <= n; i += 4) {
+        vst1q_f32(dst+i, vaddq_f32(vld1q_f32(dst+i), vld1q_f32(src+i)));
+    }
+#endif
+    for (; i < n; i++) {
+        dst[i] += src[i];
+    }
+}
+
+/* dst -= src */
+static void mix_sub(float *dst, const float *src, int n)
+{
+    int i = 0;
+#if defined(FF_MIXER_SSE2)
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(dst+i, _mm_sub_ps(_mm_loadu_ps(dst+i), _mm_loadu_ps(src+i)));
+    }
+#elif defined(FF_MIXER_NEON)
+    for (; i + 4 <= n; i += 4) {
+        vst1q_f32(dst+i, vsubq_f32(vld1q_f32(dst+i), vld1q_f32(src+i)));
+    }
+#endif
+    for (; i < n; i++) {
+        dst[i] -= src[i];
+    }
+}
+
+/* max |total - self|, self can be NULL */
+static float mix_peak(const float *total, const float *self, int n)
+{
+    float peak = 0;
+    int i = 0;
+#if defined(FF_MIXER_SSE2)
+    const __m128 mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 vpeak = _mm_setzero_ps();
+    for (; i + 4 <= n; i += 4) {
+        __m128 v = _mm_loadu_ps(total+i);
+        if (self) v = _mm_sub_ps(v, _mm_loadu_ps(self+i));
+        vpeak = _mm_max_ps(vpeak, _mm_and_ps(v, mask));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, vpeak);
+    peak = FFMAX(FFMAX(lanes[0], lanes[1]), FFMAX(lanes[2], lanes[3]));
+#elif defined(FF_MIXER_NEON)
+    float32x4_t vpeak = vdupq_n_f32(0);
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t v = vld1q_f32(total+i);
+        if (self) v = vsubq_f32(v, vld1q_f32(self+i));
+        vpeak = vmaxq_f32(vpeak, vabsq_f32(v));
+    }
+    float lanes[4];
+    vst1q_f32(lanes, vpeak);
+    peak = FFMAX(FFMAX(lanes[0], lanes[1]), FFMAX(lanes[2], lanes[3]));
+#endif
+    for (; i < n; i++) {
+        float v = self ? total[i] - self[i] : total[i];
+        peak = FFMAX(peak, v < 0 ? -v : v);
+    }
+    return peak;
+}
+
+/* out = clip((total - self) * gain) as s16 */
+static void mix_output_s16(const float *total, const float *self, float gain, int16_t *out, int n)
+{
+    int i = 0;
+#if defined(FF_MIXER_SSE2)
+    const __m128 vgain = _mm_set1_ps(gain * 32767.0f);
+    for (; i + 8 <= n; i += 8) {
+        __m128 v0 = _mm_loadu_ps(total+i);
+        __m128 v1 = _mm_loadu_ps(total+i+4);
+        if (self) {
+            v0 = _mm_sub_ps(v0, _mm_loadu_ps(self+i));
+            v1 = _mm_sub_ps(v1, _mm_loadu_ps(self+i+4));
+        }
+        __m128i s0 = _mm_cvttps_epi32(_mm_mul_ps(v0, vgain)); // truncated as NEON/scalar
+        __m128i s1 = _mm_cvttps_epi32(_mm_mul_ps(v1, vgain));
+        _mm_storeu_si128((__m128i *)(out+i), _mm_packs_epi32(s0, s1)); // saturated
+    }
+#elif defined(FF_MIXER_NEON)
+    const float32x4_t vgain = vdupq_n_f32(gain * 32767.0f);
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t v = vld1q_f32(total+i);
+        if (self) v = vsubq_f32(v, vld1q_f32(self+i));
+        int32x4_t s = vcvtq_s32_f32(vmulq_f32(v, vgain));
+        vst1_s16(out+i, vqmovn_s32(s)); // saturated
+    }
+#endif
+    for (; i < n; i++) {
+        float v = (self ? total[i] - self[i] : total[i]) * (gain * 32767.0f);
+        out[i] = (int16_t)(v > 32767.0f ? 32767 : (v < -32768.0f ? -32768 : (int)v));
+    }
+}
+
+/* out = clip((total - self) * gain) as float */
+static void mix_output_flt(const float *total, const float *self, float gain, float *out, int n)
+{
+    int i = 0;
+#if defined(FF_MIXER_SSE2)
+    const __m128 vgain = _mm_set1_ps(gain);
+    const __m128 vmax = _mm_set1_ps(1.0f);
+    const __m128 vmin = _mm_set1_ps(-1.0f);
+    for (; i + 4 <= n; i += 4) {
+        __m128 v = _mm_loadu_ps(total+i);
+        if (self) v = _mm_sub_ps(v, _mm_loadu_ps(self+i));
+        v = _mm_min_ps(_mm_max_ps(_mm_mul_ps(v, vgain), vmin), vmax);
+        _mm_storeu_ps(out+i, v);
+    }
+#elif defined(FF_MIXER_NEON)
+    const float32x4_t vgain = vdupq_n_f32(gain);
+    const float32x4_t vmax = vdupq_n_f32(1.0f);
+    const float32x4_t vmin = vdupq_n_f32(-1.0f);
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t v = vld1q_f32(total+i);
+        if (self) v = vsubq_f32(v, vld1q_f32(self+i));
+        v = vminq_f32(vmaxq_f32(vmulq_f32(v, vgain), vmin), vmax);
+        vst1q_f32(out+i, v);
+    }
+#endif
+    for (; i < n; i++) {
+        float v = (self ? total[i] - self[i] : total[i]) * gain;
+        out[i] = v > 1.0f ? 1.0f : (v < -1.0f ? -1.0f : v);
+    }
+}
+
+
+FFMixer::FFMixer() {
+    m_fmt.reset();
+    m_frame_size = 0;
+    m_total = NULL;
+    m_gain = 1.0f;
+}
+
+FFMixer::~FFMixer() {
+    close();
+}
+
+long FFMixer::open(const FFAudioFormat &fmt, int frame_size) {
+    returnv_if_fail(!m_total, 1); // opened
+    returnv_if_fail(fmt.sample_rate > 0 && fmt.channels > 0 && frame_size > 0, -1);
+    if (fmt.sample_fmt != FF_SAMPLE_FMT_S16 && fmt.sample_fmt != FF_SAMPLE_FMT_FLT) {
+        LOGE("unsupported output ff_sample_fmt="<<fmt.sample_fmt);
+        return -1;
+    }
+
+    m_total = (float *)av_mallocz(sizeof(float) * frame_size * fmt.channels);
+    returnv_if_fail(m_total, -1);
+    m_fmt = fmt;
+    m_frame_size = frame_size;
+    m_gain = 1.0f;
+    return 0;
+}
+
+void FFMixer::close() {
+    for (size_t i = 0; i < m_streams.size(); i++) {
+        av_free(m_streams[i].samples);
+    }
+    m_streams.clear();
+    av_free(m_total);
+    m_total = NULL;
+    m_fmt.reset();
+    m_frame_size = 0;
+}
+
+FFMixer::Stream *FFMixer::findStream(int stream_id) {
+    for (size_t i = 0; i < m_streams.size(); i++) {
+        if (m_streams[i].id == stream_id)
+            return &m_streams[i];
+    }
+    return NULL;
+}
+
+// return 0 if success, else < 0
+long FFMixer::addFrame(int stream_id, const AVFrame *frame) {
+    returnv_if_fail(m_total, -1);
+    returnv_if_fail(frame && frame->nb_samples > 0, -1);
+    if (frame->sample_rate != m_fmt.sample_rate) {
+        LOGE("unmatched sample_rate="<<frame->sample_rate<<", required="<<m_fmt.sample_rate);
+        return -1;
+    }
+    int in_channels = frame->channels;
+    returnv_if_fail(in_channels > 0, -1);
+
+    int count = m_frame_size * m_fmt.channels;
+    Stream *stream = findStream(stream_id);
+    if (!stream) {
+        Stream one;
+        one.id = stream_id;
+        one.active = false;
+        one.gain = 1.0f;
+        one.filled = 0;
+        one.samples = (float *)av_mallocz(sizeof(float) * count);
+        returnv_if_fail(one.samples, -1);
+        m_streams.push_back(one);
+        stream = &m_streams.back();
+    }
+
+    int nb_samples = frame->nb_samples;
+    if ((int)stream->carry.size() + nb_samples * m_fmt.channels > MAX_CARRY_PERIODS * count) {
+        LOGE("too many samples carried for stream="<<stream_id<<", and drop frame");
+        return -1;
+    }
+
+    m_convert.resize((size_t)nb_samples * m_fmt.channels);
+    float *converted = &m_convert[0];
+    switch(frame->format) {
+        case AV_SAMPLE_FMT_U8:
+        case AV_SAMPLE_FMT_U8P:
+            convert_frame<uint8_t>(frame, frame->format == AV_SAMPLE_FMT_U8P, in_channels, nb_samples,
+                    m_fmt.channels, converted);
+            break;
+        case AV_SAMPLE_FMT_S16:
+        case AV_SAMPLE_FMT_S16P:
+            convert_frame<int16_t>(frame, frame->format == AV_SAMPLE_FMT_S16P, in_channels, nb_samples,
+                    m_fmt.channels, converted);
+            break;
+        case AV_SAMPLE_FMT_S32:
+        case AV_SAMPLE_FMT_S32P:
+            convert_frame<int32_t>(frame, frame->format == AV_SAMPLE_FMT_S32P, in_channels, nb_samples,
+                    m_fmt.channels, converted);
+            break;
+        case AV_SAMPLE_FMT_FLT:
+        case AV_SAMPLE_FMT_FLTP:
+            convert_frame<float>(frame, frame->format == AV_SAMPLE_FMT_FLTP, in_channels, nb_samples,
+                    m_fmt.channels, converted);
+            break;
+        case AV_SAMPLE_FMT_DBL:
+        case AV_SAMPLE_FMT_DBLP:
+            convert_frame<double>(frame, frame->format == AV_SAMPLE_FMT_DBLP, in_channels, nb_samples,
+                    m_fmt.channels, converted);
+            break;
+        default:
+            LOGE("unsupported frame sample_fmt="<<frame->format);
+            return -1;
+    }
+
+    // replace the full period added without carry
+    if (stream->active && stream->filled == m_frame_size && stream->carry.empty()) {
+        mix_sub(m_total, stream->samples, count);
+        memset(stream->samples, 0, sizeof(float) * count);
+        stream->filled = 0;
+    }
+
+    // fill current period, and carry the rest
+    int fit = stream->carry.empty() ? FFMIN(nb_samples, m_frame_size - stream->filled) : 0;
+    if (fit > 0) {
+        int offset = stream->filled * m_fmt.channels;
+        memcpy(stream->samples + offset, converted, sizeof(float) * fit * m_fmt.channels);
+        mix_add(m_total + offset, converted, fit * m_fmt.channels);
+        stream->filled += fit;
+    }
+    stream->carry.insert(stream->carry.end(), converted + fit * m_fmt.channels,
+            converted + nb_samples * m_fmt.channels);
+    stream->active = true;
+    return 0;
+}
+
+void FFMixer::removeStream(int stream_id) {
+    for (size_t i = 0; i < m_streams.size(); i++) {
+        if (m_streams[i].id == stream_id) {
+            if (m_streams[i].active)
+                mix_sub(m_total, m_streams[i].samples, m_frame_size * m_fmt.channels);
+            av_free(m_streams[i].samples);
+            m_streams.erase(m_streams.begin() + i);
+            return;
+        }
+    }
+}
+
+// return 0 if success, else < 0
+long FFMixer::output(const float *self, float &gain, uint8_t *out_data, int &out_size) {
+    int count = m_frame_size * m_fmt.channels;
+    int data_size = count * av_get_bytes_per_sample(GetAVSampleFormat(m_fmt.sample_fmt));
+    returnv_if_fail(out_data && out_size >= data_size, -1);
+
+    // limiter
+    float peak = mix_peak(m_total, self, count);
+    float target = peak > 1.0f ? 1.0f / peak : 1.0f;
+    if (target < gain) {
+        gain = target;
+    }else {
+        gain = FFMIN(target, gain + LIMITER_RELEASE);
+    }
+
+    if (m_fmt.sample_fmt == FF_SAMPLE_FMT_S16) {
+        mix_output_s16(m_total, self, gain, (int16_t *)out_data, count);
+    }else {
+        mix_output_flt(m_total, self, gain, (float *)out_data, count);
+    }
+    out_size = data_size;
+    return 0;
+}
+
+// return 0 if success, else < 0
+long FFMixer::mix(uint8_t *out_data, int &out_size) {
+    returnv_if_fail(m_total, -1);
+    return output(NULL, m_gain, out_data, out_size);
+}
+
+// return 0 if success, else < 0
+long FFMixer::mixMinus(int stream_id, uint8_t *out_data, int &out_size) {
+    returnv_if_fail(m_total, -1);
+    Stream *stream = findStream(stream_id);
+    if (!stream) {
+        float gain = m_gain;
+        return output(NULL, gain, out_data, out_size);
+    }
+    return output(stream->active ? stream->samples : NULL, stream->gain, out_data, out_size);
+}
+
+void FFMixer::reset() {
+    return_if_fail(m_total);
+    int count = m_frame_size * m_fmt.channels;
+    memset(m_total, 0, sizeof(float) * count);
+    for (size_t i = 0; i < m_streams.size(); i++) {
+        Stream &stream = m_streams[i];
+        memset(stream.samples, 0, sizeof(float) * count);
+        stream.filled = 0;
+        stream.active = !stream.carry.empty();
+        if (!stream.active)
+            continue;
+
+        // carried samples start the next period
+        int size = FFMIN((int)stream.carry.size(), count);
+        memcpy(stream.samples, &stream.carry[0], sizeof(float) * size);
+        stream.carry.erase(stream.carry.begin(), stream.carry.begin() + size);
+        stream.filled = size / m_fmt.channels;
+        mix_add(m_total, stream.samples, size);
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef __FFMIXER_H_
+#define __FFMIXER_H_
+
+#include "ffparam.h"
+#include <vector>
+
+// mix decoded audio frames of many streams, and output the total mix
+// or the mix without one stream(mix-minus) for each participant.
+class FF_EXPORT FFMixer
+{
+public:
+    FFMixer();
+    virtual ~FFMixer();
+
+    // fmt: output format(interleaved FF_SAMPLE_FMT_S16 or FF_SAMPLE_FMT_FLT)
+    // frame_size: samples per channel of each mix period
+    long open(const FFAudioFormat &fmt, int frame_size);
+    void close();
+
+    // add one decoded frame of stream_id into current period, samples beyond the period
+    // are carried into next ones(e.g. 60ms opus in 20ms periods), and re-adding a full
+    // period without carry replaces it.
+    long addFrame(int stream_id, const AVFrame *frame);
+    void removeStream(int stream_id);
+
+    // mix all streams, or all streams except stream_id
+    long mix(uint8_t *out_data, int &out_size);
+    long mixMinus(int stream_id, uint8_t *out_data, int &out_size);
+
+    // clear current period and start the next one(with carried samples)
+    void reset();
+
+protected:
+    struct Stream {
+        int id;
+        bool active;    // has frame in current period
+        float gain;     // limiter gain of mix-minus output
+        float *samples;
+        int filled;     // samples per channel in current period
+        std::vector<float> carry;   // interleaved samples for next periods
+    };
+    Stream *findStream(int stream_id);
+    long output(const float *self, float &gain, uint8_t *out_data, int &out_size);
+
+private:
+    FFAudioFormat m_fmt;
+    int m_frame_size;
+    float *m_total;
+    float m_gain;       // limiter gain of total output
+    std::vector<Stream> m_streams;
+    std::vector<float> m_convert;   // converted frame
+};
+
+#endif // __FFMIXER_H_
@@ -4,6 +4,8 @@
 #include "ffheader.h"
 
 typedef void * ff_codec_t;
+typedef void (*ff_convert_func)(const uint8_t *const src[4], const int src_linesize[4],
+        uint8_t *const dst[4], const int dst_linesize[4], int width, int height);
 
 enum FFMediaType {
     FF_MEDIA_VIDEO,
@@ -51,6 +53,24 @@ enum FFCodecID {
     FF_CODEC_ID_NB
 };
 
+enum FFRateControl {
+    FF_RC_ABR,      // single pass average bitrate
+    FF_RC_CRF,      // constant quality(crf), bitrate is cap if codec requires
+    FF_RC_TWOPASS,  // two pass with first-pass stats in memory
+
+    FF_RC_NB
+};
+
+enum FFDecodeQuality {
+    FF_DECODE_QUALITY_AUTO = -1,    // follow FFDecodeGovernor
+    FF_DECODE_QUALITY_FULL,         // decode all frames fully
+    FF_DECODE_QUALITY_FAST,         // skip loop filter/idct of non-ref frames
+    FF_DECODE_QUALITY_NOREF,        // drop non-ref frames, skip all loop filter
+    FF_DECODE_QUALITY_KEY,          // decode key frames only
+
+    FF_DECODE_QUALITY_NB
+};
+
 
 class FFAudioFormat {
 public:
@@ -77,6 +97,52 @@ public:
     FFSampleFormat sample_fmt;
 };
 
+class FFDecodePolicy {
+public:
+    FFDecodePolicy() {
+        reset();
+    }
+    FFDecodePolicy(FFDecodeQuality quality, int lowres) {
+        reset();
+        set(quality, lowres);
+    }
+    void reset() {
+        set(FF_DECODE_QUALITY_FULL, 0);
+        threads = 0;
+        frame_threads = false;
+    }
+    void set(FFDecodeQuality quality, int lowres) {
+        this->quality = quality;
+        this->lowres = lowres;
+    }
+
+public:
+    FFDecodeQuality quality;
+    int lowres;     // decode at 1/(2^lowres) size, limited by codec's max_lowres
+    int threads;    // decoding threads(applied at opening), 0 for codec default
+    bool frame_threads; // allow frame threading, which delays output by threads-1 frames
+};
+
+// timestamps and user data of one frame, carried from input to its output(in output order)
+class FFTimeInfo {
+public:
+    FFTimeInfo() {
+        reset();
+    }
+    void reset() {
+        pts = AV_NOPTS_VALUE;
+        dts = AV_NOPTS_VALUE;
+        opaque = 0;
+        keyframe = false;
+    }
+
+public:
+    int64_t pts;    // AV_NOPTS_VALUE if unknown
+    int64_t dts;
+    int64_t opaque; // user data of input
+    bool keyframe;
+};
+
 class FFVideoFormat {
 public:
     FFVideoFormat() {
@@ -101,9 +167,40 @@ public:
         CodecData() {
             gop_size = 0;
             max_b_frames = 0;
+            global_header = false;
+            closed_gop = false;
+            thread_count = 0;
+            rc_mode = FF_RC_ABR;
+            crf = 23;
+            lookahead = 0;
+            pass = 0;
+            fast_first_pass = true;
+            refs = 0;
+            memory_cap = 0;
+            slices = 0;
+            slice_max_size = 0;
+            scene_detect = false;
+            max_gop_size = 0;
         }
         int gop_size;
         int max_b_frames;
+        bool global_header; // codec headers in extradata instead of stream(e.g. for mp4)
+        bool closed_gop;
+        int thread_count;   // 0 for codec default
+        FFRateControl rc_mode;
+        int crf;            // for FF_RC_CRF
+        int lookahead;      // frames, 0 for codec default
+        int pass;           // 1 or 2 for FF_RC_TWOPASS
+        bool fast_first_pass;
+        int refs;           // reference frames, 0 for codec default
+        // bytes per session, 0 for no cap. lookahead, then threads, then refs are shrunk to fit the
+        // estimated usage at opening, and the codec is reopened smaller when input scaler or buffers
+        // go over it while encoding(not for global_header or two pass, whose headers/stats are fixed).
+        int64_t memory_cap;
+        int slices;         // slices(h264) or token partitions(vp8) per frame, 0 for one(see FFSliceCallback)
+        int slice_max_size; // bytes per slice(h264), 0 for no limit
+        bool scene_detect;  // keyframes at scene cuts, and gop stretched on static content
+        int max_gop_size;   // stretched gop for scene_detect, 0 for 2 * gop_size
     };
 
 public:
@@ -115,5 +212,80 @@ public:
     CodecData data;
 };
 
+// first pass statistics for FF_RC_TWOPASS
+class FFPassStats {
+public:
+    void reset() {
+        stats.clear();
+        mbtree.clear();
+    }
+
+public:
+    std::string stats;
+    std::string mbtree; // x264 macroblock-tree data
+};
+
+// bytes held by one session, per component
+class FFMemoryUsage {
+public:
+    FFMemoryUsage() {
+        reset();
+    }
+    void reset() {
+        frames = 0;
+        lookahead = 0;
+        refs = 0;
+        threads = 0;
+        scaler = 0;
+    }
+    int64_t total() const {
+        return frames + lookahead + refs + threads + scaler;
+    }
+
+public:
+    int64_t frames;     // pooled frame buffers(measured)
+    int64_t lookahead;  // lookahead and b-frames queue(estimated)
+    int64_t refs;       // reference frames(estimated)
+    int64_t threads;    // frames in flight of codec threads(estimated)
+    int64_t scaler;     // sws filter buffers(estimated)
+};
+
+// quality of one encoded video frame(luma), against its input
+class FFQualityStats {
+public:
+    FFQualityStats() {
+        pts = AV_NOPTS_VALUE;
+        psnr = 0;
+        ssim = 0;
+    }
+
+public:
+    int64_t pts;    // input frame index
+    double psnr;    // dB
+    double ssim;    // 0..1
+};
+
+// scene analysis of one video frame
+class FFSceneInfo {
+public:
+    FFSceneInfo() {
+        reset();
+    }
+    void reset() {
+        score = 0;
+        hist_diff = 0;
+        scene_cut = false;
+        still = false;
+        keyframe = false;
+    }
+
+public:
+    double score;       // mean abs diff of downsampled luma(0..255)
+    double hist_diff;   // luma histogram change(0..1)
+    bool scene_cut;
+    bool still;         // static content
+    bool keyframe;      // forced by encoder
+};
+
 #endif // __FFPARAM_H_
 
@@ -0,0 +1,185 @@
+#include "ffplace.h"
+#include "fflog.h"
+#include "ffthread.h"
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#define NODE_PATH   "/sys/devices/system/node/node%d/cpulist"
+#define MAX_NODES   64
+
+static FFMutex s_place_mutex;
+static std::vector<int> s_node_loads;   // sessions weight per node
+static bool s_nodes_probed = false;
+
+/* parse cpulist like "0-7,16-23" */
+static void parse_cpulist(const char *list, std::vector<int> &cpus) {
+    cpus.clear();
+    const char *p = list;
+    while (*p) {
+        char *end = NULL;
+        long first = strtol(p, &end, 10);
+        if (end == p)
+            break;
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            p = end;
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            cpus.push_back((int)cpu);
+        }
+        while (*p == ',' || *p == '\n' || *p == ' ')
+            p++;
+    }
+}
+
+static bool read_node_cpus(int node, std::vector<int> &cpus) {
+    char path[128];
+    snprintf(path, sizeof(path), NODE_PATH, node);
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return false;
+    char list[1024] = { 0 };
+    bool ok = (fgets(list, sizeof(list), fp) != NULL);
+    fclose(fp);
+    if (ok)
+        parse_cpulist(list, cpus);
+    return ok && !cpus.empty();
+}
+
+// under s_place_mutex
+static void probe_nodes() {
+    if (s_nodes_probed)
+        return;
+    s_nodes_probed = true;
+
+    std::vector<int> cpus;
+    int count = 0;
+    for (int node = 0; node < MAX_NODES; node++) {
+        if (read_node_cpus(node, cpus))
+            count = node + 1;
+    }
+    s_node_loads.assign(FFMAX(count, 1), 0);
+}
+
+
+int FFPlacer::getNodeCount() {
+    FFAutoLock lock(s_place_mutex);
+    probe_nodes();
+    return (int)s_node_loads.size();
+}
+
+// return 0 if success, else < 0
+long FFPlacer::getNodeCpus(int node, std::vector<int> &cpus) {
+    returnv_if_fail(node >= 0, -1);
+    if (!read_node_cpus(node, cpus)) {
+        // no numa info, take all online cpus as node 0
+        returnv_if_fail(node == 0, -1);
+        cpus.clear();
+        for (int cpu = 0; cpu < av_cpu_count(); cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+    return 0;
+}
+
+// return 0 if success, else < 0
+long FFPlacer::acquire(FFPlacement &placement, int weight) {
+    if (placement.node == FF_NODE_NONE) {
+        returnv_if_fail(!placement.cpus.empty(), -1);
+        return 0;
+    }
+
+    {
+        FFAutoLock lock(s_place_mutex);
+        probe_nodes();
+        if (placement.node == FF_NODE_AUTO) {
+            int best = 0;
+            for (size_t i = 1; i < s_node_loads.size(); i++) {
+                if (s_node_loads[i] < s_node_loads[best])
+                    best = (int)i;
+            }
+            placement.node = best;
+        }
+        returnv_if_fail(placement.node >= 0 && placement.node < (int)s_node_loads.size(), -1);
+        s_node_loads[placement.node] += weight;
+    }
+
+    if (placement.cpus.empty()) {
+        if (getNodeCpus(placement.node, placement.cpus) != 0) {
+            release(placement, weight);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void FFPlacer::release(const FFPlacement &placement, int weight) {
+    FFAutoLock lock(s_place_mutex);
+    if (placement.node >= 0 && placement.node < (int)s_node_loads.size()) {
+        s_node_loads[placement.node] = FFMAX(0, s_node_loads[placement.node] - weight);
+    }
+}
+
+int FFPlacer::getLoad(int node) {
+    FFAutoLock lock(s_place_mutex);
+    probe_nodes();
+    returnv_if_fail(node >= 0 && node < (int)s_node_loads.size(), 0);
+    return s_node_loads[node];
+}
+
+// return 0 if success, else < 0
+long FFPlacer::bindThread(const FFPlacement &placement, std::vector<int> *saved_cpus) {
+    returnv_if_fail(!placement.cpus.empty(), -1);
+#ifdef __linux__
+    cpu_set_t set;
+    if (saved_cpus) {
+        saved_cpus->clear();
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                if (CPU_ISSET(cpu, &set))
+                    saved_cpus->push_back(cpu);
+            }
+        }
+    }
+
+    CPU_ZERO(&set);
+    for (size_t i = 0; i < placement.cpus.size(); i++) {
+        if (placement.cpus[i] >= 0 && placement.cpus[i] < CPU_SETSIZE)
+            CPU_SET(placement.cpus[i], &set);
+    }
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        LOGW("fail to bind thread to node="<<placement.node);
+        return -1;
+    }
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+// return 0 if success, else < 0
+long FFPlacer::restoreThread(const std::vector<int> &cpus) {
+    FFPlacement placement;
+    placement.cpus = cpus;
+    return cpus.empty() ? 0 : bindThread(placement, NULL);
+}
+
+
+FFPlaceGuard::FFPlaceGuard(const FFPlacement &placement) {
+    m_restore = false;
+    if (!placement.cpus.empty()) {
+        long lret = FFPlacer::bindThread(placement, placement.bind_caller ? NULL : &m_saved_cpus);
+        m_restore = (lret == 0 && !placement.bind_caller);
+    }
+}
+
+FFPlaceGuard::~FFPlaceGuard() {
+    if (m_restore)
+        FFPlacer::restoreThread(m_saved_cpus);
+}
@@ -0,0 +1,59 @@
+#ifndef __FFPLACE_H_
+#define __FFPLACE_H_
+
+#include "ffparam.h"
+#include <vector>
+
+#define FF_NODE_NONE    -1  // no placement
+#define FF_NODE_AUTO    -2  // node with least load, by FFPlacer
+
+// where a codec session runs and allocates its frame buffers
+class FFPlacement {
+public:
+    FFPlacement() {
+        reset();
+    }
+    void reset() {
+        node = FF_NODE_NONE;
+        cpus.clear();
+        bind_caller = false;
+    }
+
+public:
+    int node;               // numa node, or FF_NODE_NONE/FF_NODE_AUTO
+    std::vector<int> cpus;  // empty for all cpus of node, or bound alone with FF_NODE_NONE
+    bool bind_caller;       // keep the opening thread(which converts frames) bound too
+};
+
+// cpu affinity and numa placement(Linux only, no-op elsewhere).
+// codec threads are created in avcodec_open2, so they inherit the affinity bound around it.
+class FF_EXPORT FFPlacer
+{
+public:
+    static int getNodeCount();
+    static long getNodeCpus(int node, std::vector<int> &cpus);
+
+    // resolve placement(FF_NODE_AUTO by least load) and account its load, return 0 if success, else < 0.
+    // cpus without node are only bound, no node load or allocator.
+    static long acquire(FFPlacement &placement, int weight = 1);
+    static void release(const FFPlacement &placement, int weight = 1);
+    static int getLoad(int node);
+
+    // bind calling thread to placement, and return its old cpus for restore
+    static long bindThread(const FFPlacement &placement, std::vector<int> *saved_cpus = NULL);
+    static long restoreThread(const std::vector<int> &cpus);
+};
+
+// bind calling thread in scope(e.g. around avcodec_open2), and restore unless bind_caller
+class FF_EXPORT FFPlaceGuard
+{
+public:
+    explicit FFPlaceGuard(const FFPlacement &placement);
+    ~FFPlaceGuard();
+
+private:
+    bool m_restore;
+    std::vector<int> m_saved_cpus;
+};
+
+#endif // __FFPLACE_H_
@@ -0,0 +1,82 @@
+#ifndef __FFREGISTRY_H_
+#define __FFREGISTRY_H_
+
+#include "ffparam.h"
+
+// compile-time registry of formats: each FF enum value has one entry here,
+// which generates its traits(for compile-time use) and O(1) lookups in ffcodec.cpp.
+
+#define FF_STATIC_ASSERT(cond, name) typedef char ff_static_assert_##name[(cond) ? 1 : -1]
+
+// X(ff pix_fmt, av pix_fmt, bits per pixel, planes, name)
+#define FF_PIX_FMT_REGISTRY(X) \
+    X(FF_PIX_FMT_I420,  AV_PIX_FMT_YUV420P, 12, 3, "I420" ) \
+    X(FF_PIX_FMT_RGB24, AV_PIX_FMT_RGB24,   24, 1, "RGB24") \
+    X(FF_PIX_FMT_BGR24, AV_PIX_FMT_BGR24,   24, 1, "BGR24") \
+    X(FF_PIX_FMT_NV21,  AV_PIX_FMT_NV21,    12, 2, "NV21" )
+
+// X(ff codec_id, av codec_id, media type, fourcc)
+#define FF_CODEC_ID_REGISTRY(X) \
+    X(FF_CODEC_ID_NONE, AV_CODEC_ID_NONE,  FF_MEDIA_VIDEO, "    ") \
+    X(FF_CODEC_ID_OPUS, AV_CODEC_ID_OPUS,  FF_MEDIA_AUDIO, "opus") \
+    X(FF_CODEC_ID_MP2,  AV_CODEC_ID_MP2,   FF_MEDIA_AUDIO, "mp2 ") \
+    X(FF_CODEC_ID_MJPG, AV_CODEC_ID_MJPEG, FF_MEDIA_VIDEO, "mjpg") \
+    X(FF_CODEC_ID_VP8,  AV_CODEC_ID_VP8,   FF_MEDIA_VIDEO, "vp8 ") \
+    X(FF_CODEC_ID_H264, AV_CODEC_ID_H264,  FF_MEDIA_VIDEO, "h264")
+
+// X(ff sample_fmt, av sample_fmt, bytes per sample, planar, name be, name le)
+#define FF_SAMPLE_FMT_REGISTRY(X) \
+    X(FF_SAMPLE_FMT_U8,   AV_SAMPLE_FMT_U8,   1, 0, "u8",     "u8"    ) \
+    X(FF_SAMPLE_FMT_S16,  AV_SAMPLE_FMT_S16,  2, 0, "s16be",  "s16le" ) \
+    X(FF_SAMPLE_FMT_S32,  AV_SAMPLE_FMT_S32,  4, 0, "s32be",  "s32le" ) \
+    X(FF_SAMPLE_FMT_FLT,  AV_SAMPLE_FMT_FLT,  4, 0, "f32be",  "f32le" ) \
+    X(FF_SAMPLE_FMT_DBL,  AV_SAMPLE_FMT_DBL,  8, 0, "f64be",  "f64le" ) \
+    X(FF_SAMPLE_FMT_U8P,  AV_SAMPLE_FMT_U8P,  1, 1, "u8p",    "u8p"   ) \
+    X(FF_SAMPLE_FMT_S16P, AV_SAMPLE_FMT_S16P, 2, 1, "s16pbe", "s16ple") \
+    X(FF_SAMPLE_FMT_S32P, AV_SAMPLE_FMT_S32P, 4, 1, "s32pbe", "s32ple") \
+    X(FF_SAMPLE_FMT_FLTP, AV_SAMPLE_FMT_FLTP, 4, 1, "f32pbe", "f32ple") \
+    X(FF_SAMPLE_FMT_DBLP, AV_SAMPLE_FMT_DBLP, 8, 1, "f64pbe", "f64ple")
+
+
+// traits are only defined for registered values
+template <int F> struct pix_fmt_traits;
+template <int F> struct codec_id_traits;
+template <int F> struct sample_fmt_traits;
+
+#define FF_PIX_FMT_TRAITS(ff, av, bits, nb_planes, str) \
+    template <> struct pix_fmt_traits<ff> { \
+        static const AVPixelFormat av_pix_fmt = av; \
+        enum { bpp = bits, planes = nb_planes }; \
+    };
+FF_PIX_FMT_REGISTRY(FF_PIX_FMT_TRAITS)
+
+#define FF_CODEC_ID_TRAITS(ff, av, type, str) \
+    template <> struct codec_id_traits<ff> { \
+        static const AVCodecID av_codec_id = av; \
+        static const FFMediaType media_type = type; \
+    };
+FF_CODEC_ID_REGISTRY(FF_CODEC_ID_TRAITS)
+
+#define FF_SAMPLE_FMT_TRAITS(ff, av, nb_bytes, is_planar, str_be, str_le) \
+    template <> struct sample_fmt_traits<ff> { \
+        static const AVSampleFormat av_sample_fmt = av; \
+        enum { bytes = nb_bytes, planar = is_planar }; \
+    };
+FF_SAMPLE_FMT_REGISTRY(FF_SAMPLE_FMT_TRAITS)
+
+
+// every value in [Begin, End) must be registered, or sizeof fails on incomplete traits
+template <template <int> class Traits, int Begin, int End>
+struct registry_check {
+    enum { value = (sizeof(Traits<Begin>) > 0) && registry_check<Traits, Begin + 1, End>::value };
+};
+template <template <int> class Traits, int End>
+struct registry_check<Traits, End, End> {
+    enum { value = 1 };
+};
+
+FF_STATIC_ASSERT((registry_check<pix_fmt_traits, 0, FF_PIX_FMT_NB>::value), pix_fmt_registry);
+FF_STATIC_ASSERT((registry_check<codec_id_traits, 0, FF_CODEC_ID_NB>::value), codec_id_registry);
+FF_STATIC_ASSERT((registry_check<sample_fmt_traits, 0, FF_SAMPLE_FMT_NB>::value), sample_fmt_registry);
+
+#endif // __FFREGISTRY_H_
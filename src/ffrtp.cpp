@@ -0,0 +1,374 @@
+#include "ffrtp.h"
+#include "fflog.h"
+#include "ffcodec.h"
+
+#define H264_NAL_STAP_A 24
+#define H264_NAL_FU_A   28
+#define H264_STAP_A_MAX ((FF_RTP_MAX_IOV) / 2)  // nals of one STAP-A
+
+#define VP8_DESC_S      0x10    // start of partition
+#define VP8_DESC_X      0x80    // extended control bits
+#define VP8_PID_MASK    0x07
+
+static const uint8_t k_start_code[4] = { 0, 0, 0, 1 };
+
+
+FFRtpPacketizer::FFRtpPacketizer() {
+    m_codec_id = FF_CODEC_ID_NONE;
+    m_mtu = 0;
+}
+
+FFRtpPacketizer::~FFRtpPacketizer() {
+    close();
+}
+
+// return 0 if success, else < 0
+long FFRtpPacketizer::open(FFCodecID codec_id, int mtu) {
+    returnv_if_fail(mtu > 16, -1);
+    switch(codec_id) {
+        case FF_CODEC_ID_H264:
+        case FF_CODEC_ID_VP8:
+        case FF_CODEC_ID_OPUS:
+            break;
+        default:
+            LOGE("unsupported rtp codec_id="<<codec_id);
+            return -1;
+    }
+    m_codec_id = codec_id;
+    m_mtu = mtu;
+    return 0;
+}
+
+void FFRtpPacketizer::close() {
+    m_codec_id = FF_CODEC_ID_NONE;
+    m_mtu = 0;
+    m_payloads.clear();
+    m_nals.clear();
+}
+
+// payloads keep pointers to their own headers, so never grow over reserved
+FFRtpPayload *FFRtpPacketizer::addPayload() {
+    returnv_if_fail(m_payloads.size() < m_payloads.capacity(), NULL);
+    m_payloads.push_back(FFRtpPayload());
+    FFRtpPayload *payload = &m_payloads.back();
+    payload->iovcnt = 0;
+    payload->size = 0;
+    payload->marker = false;
+    return payload;
+}
+
+void FFRtpPacketizer::addIov(FFRtpPayload *payload, const uint8_t *data, int size) {
+    payload->iov[payload->iovcnt].iov_base = (void *)data;
+    payload->iov[payload->iovcnt].iov_len = size;
+    payload->iovcnt++;
+    payload->size += size;
+}
+
+// return 0 if success, else < 0
+long FFRtpPacketizer::packetize(const uint8_t *data, int size, const FFRtpPayload *&payloads, int &count) {
+    returnv_if_fail(m_codec_id != FF_CODEC_ID_NONE, -1);
+    returnv_if_fail(data && size > 0, -1);
+
+    payloads = NULL;
+    count = 0;
+    m_payloads.clear();
+
+    long lret = -1;
+    switch(m_codec_id) {
+        case FF_CODEC_ID_H264:
+            lret = packetizeH264(data, size);
+            break;
+        case FF_CODEC_ID_VP8:
+            lret = packetizeVP8(data, size);
+            break;
+        case FF_CODEC_ID_OPUS:
+            // one opus packet per rtp payload
+            m_payloads.reserve(1);
+            addIov(addPayload(), data, size);
+            lret = 0;
+            break;
+        default:
+            break;
+    }
+    returnv_if_fail(lret == 0 && !m_payloads.empty(), -1);
+
+    m_payloads.back().marker = true;
+    payloads = &m_payloads[0];
+    count = (int)m_payloads.size();
+    return 0;
+}
+
+long FFRtpPacketizer::packetizeH264(const uint8_t *data, int size) {
+    m_nals.clear();
+    int pos = find_start_code(data, size, 0);
+    while (pos < size) {
+        int start = skip_start_code(data, size, pos);
+        pos = find_start_code(data, size, start);
+        if (pos > start)
+            m_nals.push_back(std::make_pair(start, pos - start));
+    }
+    returnv_if_fail(!m_nals.empty(), -1);
+    m_payloads.reserve(m_nals.size() + size / (m_mtu - 2) + 1);
+
+    size_t i = 0;
+    while (i < m_nals.size()) {
+        const uint8_t *nal = data + m_nals[i].first;
+        int nal_size = m_nals[i].second;
+
+        if (nal_size > m_mtu) {
+            // FU-A: fragments of nal payload after its header
+            int offset = 1;
+            while (offset < nal_size) {
+                int chunk = FFMIN(m_mtu - 2, nal_size - offset);
+                FFRtpPayload *payload = addPayload();
+                returnv_if_fail(payload, -1);
+                payload->header[0] = (nal[0] & 0xe0) | H264_NAL_FU_A;
+                payload->header[1] = (nal[0] & 0x1f);
+                if (offset == 1)
+                    payload->header[1] |= 0x80;
+                if (offset + chunk == nal_size)
+                    payload->header[1] |= 0x40;
+                addIov(payload, payload->header, 2);
+                addIov(payload, nal + offset, chunk);
+                offset += chunk;
+            }
+            i++;
+            continue;
+        }
+
+        // aggregate following small nals into STAP-A
+        size_t j = i;
+        int total = 1;
+        while (j < m_nals.size() && j - i < H264_STAP_A_MAX && total + 2 + m_nals[j].second <= m_mtu) {
+            total += 2 + m_nals[j].second;
+            j++;
+        }
+
+        FFRtpPayload *payload = addPayload();
+        returnv_if_fail(payload, -1);
+        if (j - i <= 1) {
+            addIov(payload, nal, nal_size);
+            i++;
+            continue;
+        }
+
+        uint8_t f_nri = 0;
+        for (size_t k = i; k < j; k++) {
+            uint8_t hdr = data[m_nals[k].first];
+            f_nri = (uint8_t)(FFMAX(f_nri & 0x60, hdr & 0x60) | ((f_nri | hdr) & 0x80));
+        }
+        payload->header[0] = f_nri | H264_NAL_STAP_A;
+        int hpos = 1;
+        for (size_t k = i; k < j; k++) {
+            uint8_t *hdr = payload->header + hpos;
+            hdr[0] = (uint8_t)(m_nals[k].second >> 8);
+            hdr[1] = (uint8_t)(m_nals[k].second & 0xff);
+            if (k == i) {
+                addIov(payload, payload->header, 3); // with the first size
+            }else {
+                addIov(payload, hdr, 2);
+            }
+            addIov(payload, data + m_nals[k].first, m_nals[k].second);
+            hpos += 2;
+        }
+        i = j;
+    }
+    return 0;
+}
+
+long FFRtpPacketizer::packetizeVP8(const uint8_t *data, int size) {
+    int chunk_size = m_mtu - 1;
+    m_payloads.reserve(size / chunk_size + 1);
+
+    // one-byte descriptor: S and PID=0 only at frame start
+    for (int offset = 0; offset < size; offset += chunk_size) {
+        FFRtpPayload *payload = addPayload();
+        returnv_if_fail(payload, -1);
+        payload->header[0] = (offset == 0) ? VP8_DESC_S : 0;
+        addIov(payload, payload->header, 1);
+        addIov(payload, data + offset, FFMIN(chunk_size, size - offset));
+    }
+    return 0;
+}
+
+
+FFRtpDepacketizer::FFRtpDepacketizer() {
+    m_codec_id = FF_CODEC_ID_NONE;
+    m_size = 0;
+    m_started = false;
+    m_seq = 0;
+    m_corrupted = false;
+    m_in_fu = false;
+}
+
+FFRtpDepacketizer::~FFRtpDepacketizer() {
+    close();
+}
+
+// return 0 if success, else < 0
+long FFRtpDepacketizer::open(FFCodecID codec_id) {
+    switch(codec_id) {
+        case FF_CODEC_ID_H264:
+        case FF_CODEC_ID_VP8:
+        case FF_CODEC_ID_OPUS:
+            break;
+        default:
+            LOGE("unsupported rtp codec_id="<<codec_id);
+            return -1;
+    }
+    m_codec_id = codec_id;
+    m_size = 0;
+    m_started = false;
+    m_corrupted = false;
+    m_in_fu = false;
+    return 0;
+}
+
+void FFRtpDepacketizer::close() {
+    m_codec_id = FF_CODEC_ID_NONE;
+    std::vector<uint8_t>().swap(m_frame);
+    m_size = 0;
+    m_started = false;
+}
+
+void FFRtpDepacketizer::append(const uint8_t *data, int size) {
+    size_t need = (size_t)m_size + size + AV_INPUT_BUFFER_PADDING_SIZE;
+    if (m_frame.size() < need) {
+        m_frame.resize(FFMAX(need, m_frame.size() * 2));
+    }
+    memcpy(&m_frame[m_size], data, size);
+    m_size += size;
+}
+
+void FFRtpDepacketizer::appendNal(const uint8_t *data, int size) {
+    append(k_start_code, sizeof(k_start_code));
+    append(data, size);
+}
+
+// return 0 if success, else < 0
+long FFRtpDepacketizer::depacketize(const uint8_t *payload, int size, uint16_t seq, bool marker,
+        const uint8_t *&out_data, int &out_size) {
+    returnv_if_fail(m_codec_id != FF_CODEC_ID_NONE, -1);
+    returnv_if_fail(payload && size > 0, -1);
+
+    out_data = NULL;
+    out_size = 0;
+
+    // opus packets are independent, and loss is concealed by decoder
+    if (m_codec_id == FF_CODEC_ID_OPUS) {
+        m_size = 0;
+        append(payload, size);
+        memset(&m_frame[m_size], 0, AV_INPUT_BUFFER_PADDING_SIZE);
+        out_data = &m_frame[0];
+        out_size = m_size;
+        return 0;
+    }
+
+    if (m_started && seq != m_seq) {
+        LOGW("rtp packet lost, expected seq="<<m_seq<<", got="<<seq);
+        m_corrupted = true;
+    }
+    m_started = true;
+    m_seq = seq + 1;
+
+    long lret = -1;
+    if (m_codec_id == FF_CODEC_ID_H264) {
+        lret = depacketizeH264(payload, size);
+    }else {
+        lret = depacketizeVP8(payload, size);
+    }
+    if (lret != 0)
+        m_corrupted = true;
+
+    if (!marker)
+        return 0;
+
+    // frame end
+    lret = 0;
+    if (m_corrupted) {
+        LOGW("drop corrupted frame, size="<<m_size);
+        lret = -1;
+    }else if (m_size > 0) {
+        memset(&m_frame[m_size], 0, AV_INPUT_BUFFER_PADDING_SIZE);
+        out_data = &m_frame[0];
+        out_size = m_size;
+    }
+    m_size = 0;
+    m_corrupted = false;
+    m_in_fu = false;
+    return lret;
+}
+
+long FFRtpDepacketizer::depacketizeH264(const uint8_t *payload, int size) {
+    int nal_type = payload[0] & 0x1f;
+    if (nal_type >= 1 && nal_type < H264_NAL_STAP_A) {
+        appendNal(payload, size);
+        m_in_fu = false;
+        return 0;
+    }
+
+    if (nal_type == H264_NAL_STAP_A) {
+        int pos = 1;
+        while (pos + 2 <= size) {
+            int nal_size = (payload[pos] << 8) | payload[pos+1];
+            pos += 2;
+            returnv_if_fail(nal_size > 0 && pos + nal_size <= size, -1);
+            appendNal(payload + pos, nal_size);
+            pos += nal_size;
+        }
+        m_in_fu = false;
+        return 0;
+    }
+
+    if (nal_type == H264_NAL_FU_A) {
+        returnv_if_fail(size > 2, -1);
+        uint8_t fu_header = payload[1];
+        if (fu_header & 0x80) {
+            uint8_t nal_header = (payload[0] & 0xe0) | (fu_header & 0x1f);
+            append(k_start_code, sizeof(k_start_code));
+            append(&nal_header, 1);
+            m_in_fu = true;
+        }else if (!m_in_fu) {
+            LOGW("FU-A without start");
+            return -1;
+        }
+        append(payload + 2, size - 2);
+        if (fu_header & 0x40)
+            m_in_fu = false;
+        return 0;
+    }
+
+    LOGW("unsupported h264 rtp nal_type="<<nal_type);
+    return -1;
+}
+
+long FFRtpDepacketizer::depacketizeVP8(const uint8_t *payload, int size) {
+    int pos = 0;
+    uint8_t desc = payload[pos++];
+    if (desc & VP8_DESC_X) {
+        returnv_if_fail(pos < size, -1);
+        uint8_t ext = payload[pos++];
+        if (ext & 0x80) { // I: 7 or 15 bits picture id
+            returnv_if_fail(pos < size, -1);
+            pos += (payload[pos] & 0x80) ? 2 : 1;
+        }
+        if (ext & 0x40) // L: TL0PICIDX
+            pos++;
+        if (ext & 0x30) // T or K: TID/Y/KEYIDX
+            pos++;
+    }
+    returnv_if_fail(pos < size, -1);
+
+    if ((desc & VP8_DESC_S) && (desc & VP8_PID_MASK) == 0) {
+        // new frame, and the rest of lost one has been dropped
+        if (m_size > 0) {
+            LOGW("drop incomplete frame, size="<<m_size);
+        }
+        m_size = 0;
+        m_corrupted = false;
+    }else if (m_size == 0) {
+        return -1; // frame start lost
+    }
+    append(payload + pos, size - pos);
+    return 0;
+}
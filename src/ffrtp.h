@@ -0,0 +1,80 @@
+#ifndef __FFRTP_H_
+#define __FFRTP_H_
+
+#include "ffparam.h"
+#include <sys/uio.h>
+#include <vector>
+
+#define FF_RTP_MAX_IOV  16
+
+// one rtp payload(without rtp header) as scatter-gather list,
+// pointing into the encoded packet and payload headers held here.
+class FFRtpPayload {
+public:
+    struct iovec iov[FF_RTP_MAX_IOV];
+    int iovcnt;
+    int size;           // total bytes of iov
+    bool marker;        // last payload of frame
+    uint8_t header[FF_RTP_MAX_IOV * 2];
+};
+
+// packetize encoded frames without copying:
+// h264(RFC 6184, packetization-mode=1: single NAL, STAP-A and FU-A), vp8(RFC 7741), opus(RFC 7587).
+class FF_EXPORT FFRtpPacketizer
+{
+public:
+    FFRtpPacketizer();
+    virtual ~FFRtpPacketizer();
+
+    // mtu: max payload bytes
+    long open(FFCodecID codec_id, int mtu);
+    void close();
+
+    // payloads are valid until next packetize, and so must be the frame data
+    long packetize(const uint8_t *data, int size, const FFRtpPayload *&payloads, int &count);
+
+protected:
+    long packetizeH264(const uint8_t *data, int size);
+    long packetizeVP8(const uint8_t *data, int size);
+    FFRtpPayload *addPayload();
+    void addIov(FFRtpPayload *payload, const uint8_t *data, int size);
+
+private:
+    FFCodecID m_codec_id;
+    int m_mtu;
+    std::vector<FFRtpPayload> m_payloads;
+    std::vector<std::pair<int, int> > m_nals; // offset and size
+};
+
+// reassemble rtp payloads into frames for FFDecoder(annex-b for h264)
+class FF_EXPORT FFRtpDepacketizer
+{
+public:
+    FFRtpDepacketizer();
+    virtual ~FFRtpDepacketizer();
+
+    long open(FFCodecID codec_id);
+    void close();
+
+    // return 0 if success(out_size > 0 when one frame is complete), else < 0(frame dropped).
+    // out_data is valid until next depacketize.
+    long depacketize(const uint8_t *payload, int size, uint16_t seq, bool marker,
+            const uint8_t *&out_data, int &out_size);
+
+protected:
+    long depacketizeH264(const uint8_t *payload, int size);
+    long depacketizeVP8(const uint8_t *payload, int size);
+    void append(const uint8_t *data, int size);
+    void appendNal(const uint8_t *data, int size);
+
+private:
+    FFCodecID m_codec_id;
+    std::vector<uint8_t> m_frame;   // reused, with input padding
+    int m_size;
+    bool m_started;     // got expected seq
+    uint16_t m_seq;     // expected seq
+    bool m_corrupted;   // drop until frame end
+    bool m_in_fu;       // inside h264 FU-A
+};
+
+#endif // __FFRTP_H_
@@ -0,0 +1,169 @@
+#include "ffscene.h"
+#include "fflog.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FF_SCENE_SSE2 1
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FF_SCENE_NEON 1
+#endif
+
+#define SCENE_CUT_DEFAULT   20.0
+#define SCENE_STILL_DEFAULT 1.0
+#define SCENE_HIST_CUT      0.2     // min histogram change of cut
+#define SCENE_AVG_RATIO     2.0     // cut score over average of recent frames
+#define SCENE_AVG_ALPHA     0.1
+
+
+/* sums of two horizontally adjacent 8x8 blocks */
+static void block_sum2(const uint8_t *src, int stride, int &sum0, int &sum1)
+{
+#if defined(FF_SCENE_SSE2)
+    __m128i zero = _mm_setzero_si128();
+    __m128i acc = _mm_setzero_si128();
+    for (int y = 0; y < 8; y++) {
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i *)(src + y * stride)), zero));
+    }
+    sum0 = _mm_cvtsi128_si32(acc);
+    sum1 = _mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+#elif defined(FF_SCENE_NEON)
+    uint16x8_t acc = vdupq_n_u16(0);
+    for (int y = 0; y < 8; y++) {
+        acc = vpadalq_u8(acc, vld1q_u8(src + y * stride));
+    }
+    uint64x2_t sum = vpaddlq_u32(vpaddlq_u16(acc));
+    sum0 = (int)vgetq_lane_u64(sum, 0);
+    sum1 = (int)vgetq_lane_u64(sum, 1);
+#else
+    sum0 = sum1 = 0;
+    for (int y = 0; y < 8; y++) {
+        for (int x = 0; x < 8; x++) {
+            sum0 += src[y * stride + x];
+            sum1 += src[y * stride + x + 8];
+        }
+    }
+#endif
+}
+
+/* sum of abs diff */
+static uint64_t sad(const uint8_t *a, const uint8_t *b, int n)
+{
+    uint64_t total = 0;
+    int i = 0;
+#if defined(FF_SCENE_SSE2)
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16) {
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i *)(a+i)),
+                    _mm_loadu_si128((const __m128i *)(b+i))));
+    }
+    total = (uint64_t)_mm_cvtsi128_si32(acc) + (uint64_t)_mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+#elif defined(FF_SCENE_NEON)
+    uint32x4_t acc = vdupq_n_u32(0);
+    for (; i + 16 <= n; i += 16) {
+        acc = vpadalq_u16(acc, vpaddlq_u8(vabdq_u8(vld1q_u8(a+i), vld1q_u8(b+i))));
+    }
+    uint64x2_t sum = vpaddlq_u32(acc);
+    total = vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1);
+#endif
+    for (; i < n; i++) {
+        total += (a[i] > b[i]) ? a[i] - b[i] : b[i] - a[i];
+    }
+    return total;
+}
+
+
+FFSceneDetector::FFSceneDetector() {
+    m_cut = SCENE_CUT_DEFAULT;
+    m_still = SCENE_STILL_DEFAULT;
+    reset();
+}
+
+FFSceneDetector::~FFSceneDetector() {
+}
+
+void FFSceneDetector::setThreshold(double cut, double still) {
+    m_cut = cut;
+    m_still = still;
+}
+
+void FFSceneDetector::reset() {
+    m_avg_score = 0;
+    m_thumb_width = 0;
+    m_thumb_height = 0;
+    m_cur = 0;
+    m_has_prev = false;
+}
+
+// 8x8 block means, and odd block of the row by scalar
+void FFSceneDetector::downsample(const uint8_t *luma, int stride, uint8_t *thumb) {
+    for (int by = 0; by < m_thumb_height; by++) {
+        const uint8_t *src = luma + by * 8 * stride;
+        uint8_t *dst = thumb + by * m_thumb_width;
+        int bx = 0;
+        for (; bx + 2 <= m_thumb_width; bx += 2) {
+            int sum0, sum1;
+            block_sum2(src + bx * 8, stride, sum0, sum1);
+            dst[bx] = (uint8_t)((sum0 + 32) >> 6);
+            dst[bx+1] = (uint8_t)((sum1 + 32) >> 6);
+        }
+        for (; bx < m_thumb_width; bx++) {
+            int sum = 0;
+            for (int y = 0; y < 8; y++) {
+                for (int x = 0; x < 8; x++)
+                    sum += src[y * stride + bx * 8 + x];
+            }
+            dst[bx] = (uint8_t)((sum + 32) >> 6);
+        }
+    }
+}
+
+// return 0 if success, else < 0
+long FFSceneDetector::analyze(const uint8_t *luma, int stride, int width, int height, FFSceneInfo &info) {
+    returnv_if_fail(luma && width >= 8 && height >= 8, -1);
+    info.reset();
+
+    // restart on size change
+    if (m_thumb_width != width / 8 || m_thumb_height != height / 8) {
+        reset();
+        m_thumb_width = width / 8;
+        m_thumb_height = height / 8;
+        m_thumbs[0].resize(m_thumb_width * m_thumb_height);
+        m_thumbs[1].resize(m_thumb_width * m_thumb_height);
+    }
+
+    int count = m_thumb_width * m_thumb_height;
+    uint8_t *thumb = &m_thumbs[m_cur][0];
+    downsample(luma, stride, thumb);
+
+    int *hist = m_hists[m_cur];
+    memset(hist, 0, sizeof(m_hists[0]));
+    for (int i = 0; i < count; i++) {
+        hist[thumb[i] * FF_SCENE_HIST_BINS / 256]++;
+    }
+
+    if (m_has_prev) {
+        int prev = 1 - m_cur;
+        info.score = (double)sad(thumb, &m_thumbs[prev][0], count) / count;
+        int diff = 0;
+        for (int i = 0; i < FF_SCENE_HIST_BINS; i++) {
+            diff += abs(hist[i] - m_hists[prev][i]);
+        }
+        info.hist_diff = diff / (2.0 * count);
+
+        info.scene_cut = (info.score >= m_cut && info.hist_diff >= SCENE_HIST_CUT &&
+                info.score >= SCENE_AVG_RATIO * m_avg_score);
+        info.still = (info.score < m_still);
+        if (!info.scene_cut) {
+            m_avg_score += (info.score - m_avg_score) * SCENE_AVG_ALPHA;
+        }else {
+            m_avg_score = 0;
+        }
+    }else {
+        info.scene_cut = true; // the first one
+    }
+
+    m_has_prev = true;
+    m_cur = 1 - m_cur;
+    return 0;
+}
@@ -0,0 +1,39 @@
+#ifndef __FFSCENE_H_
+#define __FFSCENE_H_
+
+#include "ffparam.h"
+#include <vector>
+
+#define FF_SCENE_HIST_BINS  16
+
+// scene-change detector on downsampled luma(8x8 block means):
+// a cut needs both large SAD(above threshold and recent average) and histogram change.
+class FF_EXPORT FFSceneDetector
+{
+public:
+    FFSceneDetector();
+    virtual ~FFSceneDetector();
+
+    // cut: mean abs diff(0..255) for cut, still: below it for static content
+    void setThreshold(double cut, double still);
+    void reset();
+
+    // analyze next frame's luma plane, return 0 if success, else < 0
+    long analyze(const uint8_t *luma, int stride, int width, int height, FFSceneInfo &info);
+
+protected:
+    void downsample(const uint8_t *luma, int stride, uint8_t *thumb);
+
+private:
+    double m_cut;
+    double m_still;
+    double m_avg_score;     // of recent frames without cut
+    int m_thumb_width;
+    int m_thumb_height;
+    std::vector<uint8_t> m_thumbs[2];
+    int m_hists[2][FF_SCENE_HIST_BINS];
+    int m_cur;
+    bool m_has_prev;
+};
+
+#endif // __FFSCENE_H_
@@ -0,0 +1,76 @@
+#include "ffthread.h"
+#include "ffheader.h"
+#include "fflog.h"
+
+FFThreadPool::FFThreadPool() {
+    m_stop = false;
+}
+
+FFThreadPool::~FFThreadPool() {
+    stop();
+}
+
+// return 0 if success, else < 0
+long FFThreadPool::start(int threads) {
+    returnv_if_fail(m_threads.empty(), 1); // started
+    returnv_if_fail(threads > 0, -1);
+
+    m_stop = false;
+    for (int i = 0; i < threads; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, run, this) != 0) {
+            LOGE("fail to create thread, index="<<i);
+            stop();
+            return -1;
+        }
+        m_threads.push_back(thread);
+    }
+    return 0;
+}
+
+void FFThreadPool::stop() {
+    m_mutex.lock();
+    m_stop = true;
+    m_cond.broadcast();
+    m_mutex.unlock();
+
+    for (size_t i = 0; i < m_threads.size(); i++) {
+        pthread_join(m_threads[i], NULL);
+    }
+    m_threads.clear();
+}
+
+// return 0 if success, else < 0
+long FFThreadPool::post(Task task, void *arg) {
+    returnv_if_fail(task, -1);
+    FFAutoLock lock(m_mutex);
+    returnv_if_fail(!m_threads.empty() && !m_stop, -1);
+    m_tasks.push_back(std::make_pair(task, arg));
+    m_cond.signal();
+    return 0;
+}
+
+int FFThreadPool::size() {
+    return (int)m_threads.size();
+}
+
+void *FFThreadPool::run(void *arg) {
+    FFThreadPool *pool = (FFThreadPool *)arg;
+    for (;;) {
+        std::pair<Task, void *> item;
+        pool->m_mutex.lock();
+        while (pool->m_tasks.empty() && !pool->m_stop) {
+            pool->m_cond.wait(pool->m_mutex);
+        }
+        if (pool->m_tasks.empty()) {
+            pool->m_mutex.unlock();
+            break; // stopped and no more tasks
+        }
+        item = pool->m_tasks.front();
+        pool->m_tasks.pop_front();
+        pool->m_mutex.unlock();
+
+        item.first(item.second);
+    }
+    return NULL;
+}
@@ -0,0 +1,86 @@
+#ifndef __FFTHREAD_H_
+#define __FFTHREAD_H_
+
+#include <pthread.h>
+#include <vector>
+#include <deque>
+
+class FFMutex {
+public:
+    FFMutex() {
+        pthread_mutex_init(&mutex, NULL);
+    }
+    ~FFMutex() {
+        pthread_mutex_destroy(&mutex);
+    }
+    void lock() {
+        pthread_mutex_lock(&mutex);
+    }
+    void unlock() {
+        pthread_mutex_unlock(&mutex);
+    }
+
+public:
+    pthread_mutex_t mutex;
+};
+
+class FFAutoLock {
+public:
+    explicit FFAutoLock(FFMutex &mutex) : m_mutex(mutex) {
+        m_mutex.lock();
+    }
+    ~FFAutoLock() {
+        m_mutex.unlock();
+    }
+
+private:
+    FFMutex &m_mutex;
+};
+
+class FFCond {
+public:
+    FFCond() {
+        pthread_cond_init(&cond, NULL);
+    }
+    ~FFCond() {
+        pthread_cond_destroy(&cond);
+    }
+    void wait(FFMutex &mutex) {
+        pthread_cond_wait(&cond, &mutex.mutex);
+    }
+    void signal() {
+        pthread_cond_signal(&cond);
+    }
+    void broadcast() {
+        pthread_cond_broadcast(&cond);
+    }
+
+public:
+    pthread_cond_t cond;
+};
+
+// fixed-size worker threads running tasks in posted order
+class FFThreadPool {
+public:
+    typedef void (*Task)(void *arg);
+
+    FFThreadPool();
+    virtual ~FFThreadPool();
+
+    long start(int threads);
+    void stop();    // wait for posted tasks
+    long post(Task task, void *arg);
+    int size();
+
+protected:
+    static void *run(void *arg);
+
+private:
+    std::vector<pthread_t> m_threads;
+    std::deque<std::pair<Task, void *> > m_tasks;
+    FFMutex m_mutex;
+    FFCond m_cond;
+    bool m_stop;
+};
+
+#endif // __FFTHREAD_H_
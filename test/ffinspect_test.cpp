@@ -0,0 +1,137 @@
+// FFPacketInspector on known packets(h264 annex-b and length prefixed, vp8, opus),
+// return 0 if all checks pass, else the count of failures.
+#include "ffinspect.h"
+#include <stdio.h>
+#include <vector>
+
+static int s_failures = 0;
+
+#define CHECK(cond, name) do { \
+        if (!(cond)) { printf("FAIL: %s\n", name); s_failures++; } \
+        else { printf("ok: %s\n", name); } \
+    }while(0)
+
+// baseline sps of 1920x1080(cropped from 1088)
+static const uint8_t k_sps_1080p[] = {
+    0x67, 0x42, 0xc0, 0x28, 0xda, 0x01, 0xe0, 0x08, 0x9f, 0x96, 0x10, 0x00, 0x00, 0x03,
+    0x00, 0x10, 0x00, 0x00, 0x03, 0x03, 0xc8, 0xf1, 0x83, 0x2a,
+};
+// high profile sps of 1280x720
+static const uint8_t k_sps_720p[] = {
+    0x67, 0x64, 0x00, 0x1f, 0xac, 0xd9, 0x40, 0x50, 0x05, 0xbb, 0x01, 0x10, 0x00, 0x00,
+    0x03, 0x00, 0x10, 0x00, 0x00, 0x03, 0x03, 0xc0, 0xf1, 0x83, 0x19, 0x60,
+};
+static const uint8_t k_idr[] = { 0x65, 0x88, 0x84, 0x00, 0x33 };
+
+static void add_annexb(std::vector<uint8_t> &packet, const uint8_t *nal, int size) {
+    static const uint8_t start_code[4] = { 0, 0, 0, 1 };
+    packet.insert(packet.end(), start_code, start_code + 4);
+    packet.insert(packet.end(), nal, nal + size);
+}
+
+static void add_avcc(std::vector<uint8_t> &packet, const uint8_t *nal, int size) {
+    packet.push_back((uint8_t)(size >> 24));
+    packet.push_back((uint8_t)(size >> 16));
+    packet.push_back((uint8_t)(size >> 8));
+    packet.push_back((uint8_t)size);
+    packet.insert(packet.end(), nal, nal + size);
+}
+
+static long inspect(FFCodecID codec_id, const std::vector<uint8_t> &packet, FFPacketInfo &info) {
+    return FFPacketInspector::inspect(codec_id, &packet[0], (int)packet.size(), info);
+}
+
+static void test_h264_sps() {
+    FFPacketInfo info;
+    std::vector<uint8_t> packet;
+    add_annexb(packet, k_sps_1080p, sizeof(k_sps_1080p));
+    add_annexb(packet, k_idr, sizeof(k_idr));
+    CHECK(inspect(FF_CODEC_ID_H264, packet, info) == 0, "annex-b sps+idr");
+    CHECK(info.width == 1920 && info.height == 1080, "baseline sps 1920x1080");
+    CHECK(info.keyframe && info.reference, "idr is key and referenced");
+
+    packet.clear();
+    add_avcc(packet, k_sps_1080p, sizeof(k_sps_1080p));
+    add_avcc(packet, k_idr, sizeof(k_idr));
+    CHECK(inspect(FF_CODEC_ID_H264, packet, info) == 0, "avcc sps+idr");
+    CHECK(info.width == 1920 && info.height == 1080 && info.keyframe, "avcc sps 1920x1080 and idr");
+
+    packet.clear();
+    add_annexb(packet, k_sps_720p, sizeof(k_sps_720p));
+    CHECK(inspect(FF_CODEC_ID_H264, packet, info) == 0, "annex-b high sps");
+    CHECK(info.width == 1280 && info.height == 720, "high sps 1280x720");
+    CHECK(!info.keyframe, "sps only is not key");
+}
+
+// a length prefix may look like a start code, so length prefixed is detected first
+static void test_h264_avcc() {
+    FFPacketInfo info;
+    const uint8_t aud[] = { 0x09 };
+    std::vector<uint8_t> packet;
+    add_avcc(packet, aud, sizeof(aud)); // 00 00 00 01 09
+    add_avcc(packet, k_idr, sizeof(k_idr));
+    CHECK(inspect(FF_CODEC_ID_H264, packet, info) == 0 && info.keyframe, "avcc with 1-byte first nal");
+
+    std::vector<uint8_t> sei(300, 0x11);
+    sei[0] = 0x06;
+    packet.clear();
+    add_avcc(packet, &sei[0], (int)sei.size()); // 00 00 01 2c 06
+    add_avcc(packet, k_idr, sizeof(k_idr));
+    CHECK(inspect(FF_CODEC_ID_H264, packet, info) == 0 && info.keyframe, "avcc with 300-byte first nal");
+
+    packet.clear();
+    add_annexb(packet, &sei[0], (int)sei.size());
+    add_annexb(packet, k_idr, sizeof(k_idr));
+    CHECK(inspect(FF_CODEC_ID_H264, packet, info) == 0 && info.keyframe, "annex-b with 300-byte first nal");
+}
+
+static void test_h264_reference() {
+    FFPacketInfo info;
+    const uint8_t non_ref[] = { 0x01, 0x9a, 0x02 }; // nal_ref_idc 0
+    const uint8_t ref[] = { 0x21, 0x9a, 0x02 };     // nal_ref_idc 1
+    std::vector<uint8_t> packet;
+    add_annexb(packet, non_ref, sizeof(non_ref));
+    CHECK(inspect(FF_CODEC_ID_H264, packet, info) == 0 && !info.reference && !info.keyframe,
+            "slice with nal_ref_idc 0 is not referenced");
+
+    packet.clear();
+    add_avcc(packet, ref, sizeof(ref));
+    CHECK(inspect(FF_CODEC_ID_H264, packet, info) == 0 && info.reference, "slice with nal_ref_idc 1 is referenced");
+}
+
+static void test_vp8() {
+    FFPacketInfo info;
+    const uint8_t key[] = { 0x50, 0x42, 0x00, 0x9d, 0x01, 0x2a, 0x80, 0x02, 0xe0, 0x01 };
+    const uint8_t inter[] = { 0x51, 0x42, 0x00 };
+    CHECK(FFPacketInspector::inspect(FF_CODEC_ID_VP8, key, sizeof(key), info) == 0, "vp8 key frame");
+    CHECK(info.keyframe && info.width == 640 && info.height == 480, "vp8 key 640x480");
+    CHECK(FFPacketInspector::inspect(FF_CODEC_ID_VP8, inter, sizeof(inter), info) == 0 && !info.keyframe,
+            "vp8 inter frame");
+}
+
+static void test_opus() {
+    FFPacketInfo info;
+    const uint8_t one[] = { 0xfc, 0x00 };       // celt 20ms stereo, code 0
+    const uint8_t two[] = { 0x19, 0x00 };       // silk 60ms mono, code 1
+    const uint8_t six[] = { 0xff, 0x06 };       // celt 20ms, code 3 of 6 frames(120ms)
+    const uint8_t seven[] = { 0xff, 0x07 };     // 140ms
+    const uint8_t none[] = { 0xff, 0x00 };      // no frame
+    CHECK(FFPacketInspector::inspect(FF_CODEC_ID_OPUS, one, sizeof(one), info) == 0 &&
+            info.channels == 2 && info.samples == 960, "opus code 0");
+    CHECK(FFPacketInspector::inspect(FF_CODEC_ID_OPUS, two, sizeof(two), info) == 0 &&
+            info.channels == 1 && info.samples == 5760, "opus code 1");
+    CHECK(FFPacketInspector::inspect(FF_CODEC_ID_OPUS, six, sizeof(six), info) == 0 &&
+            info.samples == 5760, "opus code 3 of 120ms");
+    CHECK(FFPacketInspector::inspect(FF_CODEC_ID_OPUS, seven, sizeof(seven), info) < 0, "opus code 3 over 120ms");
+    CHECK(FFPacketInspector::inspect(FF_CODEC_ID_OPUS, none, sizeof(none), info) < 0, "opus code 3 of 0 frames");
+}
+
+int main() {
+    test_h264_sps();
+    test_h264_avcc();
+    test_h264_reference();
+    test_vp8();
+    test_opus();
+    printf("%d failure(s)\n", s_failures);
+    return s_failures;
+}
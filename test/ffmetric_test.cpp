@@ -0,0 +1,118 @@
+// psnr/ssim of SIMD kernels(SSE2/NEON where built) against a scalar reference on known inputs,
+// return 0 if all checks pass, else the count of failures.
+#include "ffmetric.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+
+static int s_failures = 0;
+
+#define CHECK(cond, name) do { \
+        if (!(cond)) { printf("FAIL: %s\n", name); s_failures++; } \
+        else { printf("ok: %s\n", name); } \
+    }while(0)
+
+static double ref_psnr(const uint8_t *a, int a_stride, const uint8_t *b, int b_stride,
+        int width, int height, int step) {
+    double sse = 0, count = 0;
+    for (int y = 0; y < height; y += step) {
+        for (int x = 0; x < width; x++) {
+            double d = a[y * a_stride + x] - b[y * b_stride + x];
+            sse += d * d;
+        }
+        count += width;
+    }
+    if (sse == 0)
+        return 100.0;
+    double psnr = 10.0 * log10(255.0 * 255.0 * count / sse);
+    return psnr < 100.0 ? psnr : 100.0;
+}
+
+static double ref_ssim(const uint8_t *a, int a_stride, const uint8_t *b, int b_stride,
+        int width, int height, int step) {
+    const double c1 = (0.01 * 255) * (0.01 * 255);
+    const double c2 = (0.03 * 255) * (0.03 * 255);
+    double total = 0;
+    int count = 0;
+    for (int y = 0; y + 8 <= height; y += step * 8) {
+        for (int x = 0; x + 8 <= width; x += step * 8) {
+            double mu1 = 0, mu2 = 0;
+            for (int j = 0; j < 8; j++) {
+                for (int i = 0; i < 8; i++) {
+                    mu1 += a[(y + j) * a_stride + x + i];
+                    mu2 += b[(y + j) * b_stride + x + i];
+                }
+            }
+            mu1 /= 64;
+            mu2 /= 64;
+            double var1 = 0, var2 = 0, cov = 0;
+            for (int j = 0; j < 8; j++) {
+                for (int i = 0; i < 8; i++) {
+                    double da = a[(y + j) * a_stride + x + i] - mu1;
+                    double db = b[(y + j) * b_stride + x + i] - mu2;
+                    var1 += da * da;
+                    var2 += db * db;
+                    cov += da * db;
+                }
+            }
+            var1 /= 64;
+            var2 /= 64;
+            cov /= 64;
+            total += ((2 * mu1 * mu2 + c1) * (2 * cov + c2)) /
+                ((mu1 * mu1 + mu2 * mu2 + c1) * (var1 + var2 + c2));
+            count++;
+        }
+    }
+    return count > 0 ? total / count : 0;
+}
+
+static bool near(double x, double y) {
+    return fabs(x - y) < 1e-6;
+}
+
+// compare kernels with reference, on odd sizes for SIMD tails and padded strides
+static void test_random(int width, int height, int noise, int step) {
+    int stride = width + 13;
+    std::vector<uint8_t> a((size_t)stride * height), b((size_t)stride * height);
+    for (size_t i = 0; i < a.size(); i++) {
+        a[i] = (uint8_t)(rand() % 256);
+        int v = a[i] + rand() % (2 * noise + 1) - noise;
+        b[i] = (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+    }
+
+    char name[96];
+    snprintf(name, sizeof(name), "psnr %dx%d noise=%d step=%d", width, height, noise, step);
+    CHECK(near(ComputePlanePSNR(&a[0], stride, &b[0], stride, width, height, step),
+                ref_psnr(&a[0], stride, &b[0], stride, width, height, step)), name);
+    snprintf(name, sizeof(name), "ssim %dx%d noise=%d step=%d", width, height, noise, step);
+    CHECK(near(ComputePlaneSSIM(&a[0], stride, &b[0], stride, width, height, step),
+                ref_ssim(&a[0], stride, &b[0], stride, width, height, step)), name);
+}
+
+static void test_known() {
+    const int width = 64, height = 32;
+    std::vector<uint8_t> a(width * height), b(width * height);
+    for (size_t i = 0; i < a.size(); i++) {
+        a[i] = (uint8_t)(16 + i % 200);
+        b[i] = (uint8_t)(a[i] + 4); // constant error
+    }
+
+    CHECK(ComputePlanePSNR(&a[0], width, &a[0], width, width, height, 1) == 100.0, "psnr of identical planes");
+    CHECK(near(ComputePlaneSSIM(&a[0], width, &a[0], width, width, height, 1), 1.0), "ssim of identical planes");
+    CHECK(near(ComputePlanePSNR(&a[0], width, &b[0], width, width, height, 1), 10.0 * log10(255.0 * 255.0 / 16)),
+            "psnr of constant error 4");
+}
+
+int main() {
+    srand(1);
+    test_known();
+    const int sizes[][2] = { { 8, 8 }, { 67, 40 }, { 320, 180 }, { 641, 37 } };
+    for (size_t i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++) {
+        test_random(sizes[i][0], sizes[i][1], 3, 1);
+        test_random(sizes[i][0], sizes[i][1], 40, 1);
+        test_random(sizes[i][0], sizes[i][1], 40, 2);
+    }
+    printf("%d failure(s)\n", s_failures);
+    return s_failures;
+}
@@ -0,0 +1,167 @@
+// mix/mix-minus of SIMD kernels(SSE2/NEON where built) against a scalar reference,
+// return 0 if all checks pass, else the count of failures.
+#include "ffmixer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+static int s_failures = 0;
+
+#define CHECK(cond, name) do { \
+        if (!(cond)) { printf("FAIL: %s\n", name); s_failures++; } \
+        else { printf("ok: %s\n", name); } \
+    }while(0)
+
+static const int kSampleRate = 48000;
+
+// interleaved float frame of samples
+static void make_frame(AVFrame *frame, float *samples, int nb_samples, int channels) {
+    memset(frame, 0, sizeof(*frame));
+    frame->format = AV_SAMPLE_FMT_FLT;
+    frame->sample_rate = kSampleRate;
+    frame->channels = channels;
+    frame->nb_samples = nb_samples;
+    frame->data[0] = (uint8_t *)samples;
+    frame->extended_data = frame->data;
+}
+
+// reference limiter and output, as (total - self) * gain clipped
+static void ref_output(const float *total, const float *self, float &gain, int n, bool s16,
+        std::vector<int16_t> &out_s16, std::vector<float> &out_flt) {
+    float peak = 0;
+    for (int i = 0; i < n; i++) {
+        float v = self ? total[i] - self[i] : total[i];
+        peak = fabsf(v) > peak ? fabsf(v) : peak;
+    }
+    float target = peak > 1.0f ? 1.0f / peak : 1.0f;
+    gain = target < gain ? target : (gain + 0.05f < target ? gain + 0.05f : target);
+
+    out_s16.resize(n);
+    out_flt.resize(n);
+    for (int i = 0; i < n; i++) {
+        float v = self ? total[i] - self[i] : total[i];
+        if (s16) {
+            float s = v * (gain * 32767.0f);
+            out_s16[i] = (int16_t)(s > 32767.0f ? 32767 : (s < -32768.0f ? -32768 : (int)s));
+        }else {
+            float f = v * gain;
+            out_flt[i] = f > 1.0f ? 1.0f : (f < -1.0f ? -1.0f : f);
+        }
+    }
+}
+
+static bool same_output(const uint8_t *data, int size, bool s16,
+        const std::vector<int16_t> &out_s16, const std::vector<float> &out_flt) {
+    if (s16) {
+        return size == (int)(out_s16.size() * sizeof(int16_t)) && memcmp(data, &out_s16[0], size) == 0;
+    }
+    if (size != (int)(out_flt.size() * sizeof(float)))
+        return false;
+    const float *out = (const float *)data;
+    for (size_t i = 0; i < out_flt.size(); i++) {
+        if (fabsf(out[i] - out_flt[i]) > 1e-6f)
+            return false;
+    }
+    return true;
+}
+
+// mix random streams over some periods, on odd sizes for SIMD tails and loud ones for limiter
+static void test_random(bool s16, int channels, int frame_size, int nb_streams, float level) {
+    FFMixer mixer;
+    FFAudioFormat fmt(kSampleRate, s16 ? FF_SAMPLE_FMT_S16 : FF_SAMPLE_FMT_FLT, channels, 0);
+    char name[128];
+    snprintf(name, sizeof(name), "open %s ch=%d size=%d", s16 ? "s16" : "flt", channels, frame_size);
+    CHECK(mixer.open(fmt, frame_size) == 0, name);
+
+    int n = frame_size * channels;
+    float gain = 1.0f;
+    std::vector<float> gains(nb_streams, 1.0f);
+    std::vector<int16_t> out_s16;
+    std::vector<float> out_flt;
+    std::vector<uint8_t> data(n * sizeof(float));
+    bool mix_ok = true, minus_ok = true;
+    for (int period = 0; period < 6; period++) {
+        std::vector<std::vector<float> > samples(nb_streams, std::vector<float>(n));
+        std::vector<float> total(n, 0.0f);
+        for (int k = 0; k < nb_streams; k++) {
+            for (int i = 0; i < n; i++) {
+                samples[k][i] = level * (2.0f * rand() / RAND_MAX - 1.0f);
+                total[i] += samples[k][i];
+            }
+            AVFrame frame;
+            make_frame(&frame, &samples[k][0], frame_size, channels);
+            mix_ok = mix_ok && mixer.addFrame(k, &frame) == 0;
+        }
+
+        int size = (int)data.size();
+        mix_ok = mix_ok && mixer.mix(&data[0], size) == 0;
+        ref_output(&total[0], NULL, gain, n, s16, out_s16, out_flt);
+        mix_ok = mix_ok && same_output(&data[0], size, s16, out_s16, out_flt);
+
+        for (int k = 0; k < nb_streams; k++) {
+            size = (int)data.size();
+            minus_ok = minus_ok && mixer.mixMinus(k, &data[0], size) == 0;
+            ref_output(&total[0], &samples[k][0], gains[k], n, s16, out_s16, out_flt);
+            minus_ok = minus_ok && same_output(&data[0], size, s16, out_s16, out_flt);
+        }
+        mixer.reset();
+    }
+
+    snprintf(name, sizeof(name), "mix %s ch=%d size=%d streams=%d level=%.1f",
+            s16 ? "s16" : "flt", channels, frame_size, nb_streams, level);
+    CHECK(mix_ok, name);
+    snprintf(name, sizeof(name), "mix-minus %s ch=%d size=%d streams=%d level=%.1f",
+            s16 ? "s16" : "flt", channels, frame_size, nb_streams, level);
+    CHECK(minus_ok, name);
+}
+
+// one frame of 3 periods(e.g. 60ms opus in 20ms periods) is carried, not dropped
+static void test_carry() {
+    const int frame_size = 160;
+    FFMixer mixer;
+    FFAudioFormat fmt(kSampleRate, FF_SAMPLE_FMT_FLT, 1, 0);
+    CHECK(mixer.open(fmt, frame_size) == 0, "open carry");
+
+    std::vector<float> samples(frame_size * 3);
+    for (size_t i = 0; i < samples.size(); i++) {
+        samples[i] = (float)i / samples.size() - 0.5f;
+    }
+    AVFrame frame;
+    make_frame(&frame, &samples[0], (int)samples.size(), 1);
+    CHECK(mixer.addFrame(1, &frame) == 0, "add frame of 3 periods");
+
+    bool ok = true;
+    std::vector<float> out(frame_size);
+    for (int period = 0; period < 3; period++) {
+        int size = (int)(out.size() * sizeof(float));
+        ok = ok && mixer.mix((uint8_t *)&out[0], size) == 0;
+        ok = ok && memcmp(&out[0], &samples[period * frame_size], size) == 0;
+        mixer.reset();
+    }
+    CHECK(ok, "carried samples in next periods");
+
+    int size = (int)(out.size() * sizeof(float));
+    ok = mixer.mix((uint8_t *)&out[0], size) == 0;
+    for (int i = 0; i < frame_size; i++) {
+        ok = ok && out[i] == 0;
+    }
+    CHECK(ok, "silence after carried samples");
+}
+
+int main() {
+    srand(1);
+    test_carry();
+    const int sizes[] = { 1, 7, 160, 481 };
+    for (size_t i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++) {
+        for (int channels = 1; channels <= 2; channels++) {
+            test_random(true, channels, sizes[i], 3, 0.3f);
+            test_random(true, channels, sizes[i], 4, 0.9f);
+            test_random(false, channels, sizes[i], 3, 0.3f);
+            test_random(false, channels, sizes[i], 4, 0.9f);
+        }
+    }
+    printf("%d failure(s)\n", s_failures);
+    return s_failures;
+}
@@ -0,0 +1,155 @@
+// packetize -> depacketize round trip of FFRtpPacketizer/FFRtpDepacketizer,
+// return 0 if all checks pass, else the count of failures.
+#include "ffrtp.h"
+#include <stdio.h>
+#include <string.h>
+
+#define MTU 1200
+
+static int s_failures = 0;
+
+#define CHECK(cond, name) do { \
+        if (!(cond)) { printf("FAIL: %s\n", name); s_failures++; } \
+        else { printf("ok: %s\n", name); } \
+    }while(0)
+
+// flatten payload's iov
+static void flatten(const FFRtpPayload &payload, std::vector<uint8_t> &data) {
+    data.clear();
+    for (int i = 0; i < payload.iovcnt; i++) {
+        const uint8_t *base = (const uint8_t *)payload.iov[i].iov_base;
+        data.insert(data.end(), base, base + payload.iov[i].iov_len);
+    }
+}
+
+static void add_nal(std::vector<uint8_t> &frame, uint8_t header, int size) {
+    static const uint8_t start_code[4] = { 0, 0, 0, 1 };
+    frame.insert(frame.end(), start_code, start_code + 4);
+    frame.push_back(header);
+    for (int i = 1; i < size; i++) {
+        frame.push_back((uint8_t)((i * 7 + header) % 251 + 1));
+    }
+}
+
+// packetize frame, and check payloads(within mtu, nal types if h264)
+static bool packetize(FFRtpPacketizer &packetizer, const std::vector<uint8_t> &frame,
+        std::vector<std::vector<uint8_t> > &payloads, std::vector<bool> &markers) {
+    const FFRtpPayload *items = NULL;
+    int count = 0;
+    if (packetizer.packetize(&frame[0], (int)frame.size(), items, count) != 0)
+        return false;
+    payloads.resize(count);
+    markers.resize(count);
+    for (int i = 0; i < count; i++) {
+        flatten(items[i], payloads[i]);
+        markers[i] = items[i].marker;
+        if ((int)payloads[i].size() > MTU || (int)payloads[i].size() != items[i].size)
+            return false;
+    }
+    return count > 0 && markers[count - 1];
+}
+
+// depacketize payloads(skip the one at index lost, -1 for none), return output frame
+static long depacketize(FFRtpDepacketizer &depacketizer, uint16_t &seq,
+        const std::vector<std::vector<uint8_t> > &payloads, const std::vector<bool> &markers,
+        int lost, std::vector<uint8_t> &out) {
+    long lret = 0;
+    out.clear();
+    for (size_t i = 0; i < payloads.size(); i++, seq++) {
+        if ((int)i == lost)
+            continue;
+        const uint8_t *out_data = NULL;
+        int out_size = 0;
+        lret = depacketizer.depacketize(&payloads[i][0], (int)payloads[i].size(), seq, markers[i],
+                out_data, out_size);
+        if (out_size > 0)
+            out.assign(out_data, out_data + out_size);
+    }
+    return lret;
+}
+
+static int count_type(const std::vector<std::vector<uint8_t> > &payloads, int nal_type) {
+    int count = 0;
+    for (size_t i = 0; i < payloads.size(); i++) {
+        if ((payloads[i][0] & 0x1f) == nal_type)
+            count++;
+    }
+    return count;
+}
+
+static void test_h264() {
+    FFRtpPacketizer packetizer;
+    FFRtpDepacketizer depacketizer;
+    packetizer.open(FF_CODEC_ID_H264, MTU);
+    depacketizer.open(FF_CODEC_ID_H264);
+    uint16_t seq = 100;
+
+    std::vector<std::vector<uint8_t> > payloads;
+    std::vector<bool> markers;
+    std::vector<uint8_t> out;
+
+    // sps/pps/sei are aggregated in STAP-A, and large idr split in FU-A
+    std::vector<uint8_t> frame;
+    add_nal(frame, 0x67, 10);
+    add_nal(frame, 0x68, 5);
+    add_nal(frame, 0x06, 40);
+    add_nal(frame, 0x65, 3000);
+    CHECK(packetize(packetizer, frame, payloads, markers), "h264 stap-a/fu-a packetize");
+    CHECK(count_type(payloads, 24) == 1, "h264 stap-a aggregates small nals");
+    CHECK(count_type(payloads, 28) == 3, "h264 fu-a fragments of 3000 bytes nal");
+    CHECK(depacketize(depacketizer, seq, payloads, markers, -1, out) == 0 && out == frame,
+            "h264 stap-a/fu-a round trip");
+
+    // nals around mtu boundary: single nal up to mtu, FU-A above
+    const int sizes[] = { MTU - 1, MTU, MTU + 1, 2 * MTU, 2 * MTU + 1 };
+    for (size_t i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++) {
+        frame.clear();
+        add_nal(frame, 0x41, sizes[i]);
+        char name[64];
+        snprintf(name, sizeof(name), "h264 nal of %d bytes round trip", sizes[i]);
+        bool ok = packetize(packetizer, frame, payloads, markers);
+        ok = ok && (sizes[i] <= MTU ? payloads.size() == 1 : count_type(payloads, 28) == (int)payloads.size());
+        CHECK(ok && depacketize(depacketizer, seq, payloads, markers, -1, out) == 0 && out == frame, name);
+    }
+
+    // sequence gap inside FU-A drops the frame, and the next one recovers
+    frame.clear();
+    add_nal(frame, 0x65, 3000);
+    packetize(packetizer, frame, payloads, markers);
+    CHECK(depacketize(depacketizer, seq, payloads, markers, 1, out) < 0 && out.empty(),
+            "h264 sequence gap drops frame");
+    CHECK(depacketize(depacketizer, seq, payloads, markers, -1, out) == 0 && out == frame,
+            "h264 recovers after gap");
+}
+
+static void test_vp8() {
+    FFRtpPacketizer packetizer;
+    FFRtpDepacketizer depacketizer;
+    packetizer.open(FF_CODEC_ID_VP8, MTU);
+    depacketizer.open(FF_CODEC_ID_VP8);
+    uint16_t seq = 65530; // wraps
+
+    std::vector<std::vector<uint8_t> > payloads;
+    std::vector<bool> markers;
+    std::vector<uint8_t> out;
+
+    std::vector<uint8_t> frame(5000);
+    for (size_t i = 0; i < frame.size(); i++) {
+        frame[i] = (uint8_t)(i * 13);
+    }
+    CHECK(packetize(packetizer, frame, payloads, markers) && payloads.size() > 1, "vp8 multi-packet packetize");
+    CHECK(depacketize(depacketizer, seq, payloads, markers, -1, out) == 0 && out == frame,
+            "vp8 multi-packet round trip");
+
+    CHECK(depacketize(depacketizer, seq, payloads, markers, 2, out) < 0 && out.empty(),
+            "vp8 sequence gap drops frame");
+    CHECK(depacketize(depacketizer, seq, payloads, markers, -1, out) == 0 && out == frame,
+            "vp8 recovers after gap");
+}
+
+int main() {
+    test_h264();
+    test_vp8();
+    printf("%d failure(s)\n", s_failures);
+    return s_failures;
+}